@@ -31,6 +31,18 @@ if(NWT_ENABLE_COVERAGE)
     endif()
 endif()
 
+# Encrypt router sessions (X25519 key exchange + AES-256-GCM) with OpenSSL libcrypto.
+option(NWT_ENABLE_SESSION_CRYPTO "Encrypt router sessions with OpenSSL (X25519 + AES-256-GCM)" OFF)
+if (NWT_ENABLE_SESSION_CRYPTO)
+    add_compile_definitions(NWT_SESSION_CRYPTO)
+endif()
+
+# Loopback tests and throughput benchmarks under tests/ (needs the Qt5 Test module).
+option(NWT_BUILD_TESTS "Build loopback tests and throughput benchmarks" OFF)
+# Throughput benchmarks push hundreds of MiB each; they are registered under the
+# "benchmark" ctest label only when enabled (run with: ctest -L benchmark).
+option(NWT_BUILD_BENCHMARKS "Build and register the loopback throughput benchmarks" OFF)
+
 # ---- Dependency hint helpers ----
 
 if(DEFINED ENV{OPENSSL_PREFIX} AND NOT "$ENV{OPENSSL_PREFIX}" STREQUAL "")
@@ -13,11 +13,23 @@
 #include <QJsonObject>
 #include <QNetworkInterface>
 #include <QHostInfo>
+#include <QJsonDocument>
 #include <QSet>
+#include <QTimer>
 #include <QUuid>
 #include <limits>
 
 namespace {
+// 发件箱每批重发的消息数，批次之间留出间隔，避免积压的消息一次性涌入对端。
+constexpr int OutboxBatchSize = 50;
+constexpr int OutboxBatchIntervalMs = 200;
+// 联系人最近出现时间的批量落盘周期，其间的心跳只更新内存。
+constexpr int PeerSightingFlushMs = 30 * 1000;
+// 发出后在该时间内未确认的消息才会重发，确认通常在往返时间内到达。
+constexpr qint64 OutboxRetrySeconds = 30;
+// 接收端去重记录的保留时长。
+constexpr qint64 ReceivedMessageRetentionSeconds = 30 * 24 * 3600;
+
 bool jsonBool(const QJsonObject &object, const QString &key, bool fallback) {
     return object.contains(key) ? object.value(key).toBool(fallback) : fallback;
 }
@@ -114,6 +126,12 @@ NetworkSettings parseNetworkSettings(const QJsonObject &object) {
         jsonBool(object, QStringLiteral("restrictToListedSubnets"), settings.restrictToListedSubnets);
     settings.autoRefresh = jsonBool(object, QStringLiteral("autoRefresh"), settings.autoRefresh);
     settings.refreshIntervalMinutes = jsonInt(object, QStringLiteral("refreshInterval"), settings.refreshIntervalMinutes);
+    settings.multicastDiscovery = jsonBool(object, QStringLiteral("multicastDiscovery"), settings.multicastDiscovery);
+    settings.multicastGroup = object.value(QStringLiteral("multicastGroup")).toString(settings.multicastGroup);
+    settings.multicastTtl = jsonInt(object, QStringLiteral("multicastTtl"), settings.multicastTtl);
+    settings.maxSessions = jsonInt(object, QStringLiteral("maxSessions"), settings.maxSessions);
+    settings.sessionIdleTimeoutSeconds =
+        jsonInt(object, QStringLiteral("sessionIdleTimeout"), settings.sessionIdleTimeoutSeconds);
     return settings;
 }
 
@@ -127,7 +145,12 @@ QJsonObject networkSettingsToJson(const NetworkSettings &settings) {
         {QStringLiteral("interfaceId"), settings.boundInterfaceId},
         {QStringLiteral("restrictToListedSubnets"), settings.restrictToListedSubnets},
         {QStringLiteral("autoRefresh"), settings.autoRefresh},
-        {QStringLiteral("refreshInterval"), settings.refreshIntervalMinutes}
+        {QStringLiteral("refreshInterval"), settings.refreshIntervalMinutes},
+        {QStringLiteral("multicastDiscovery"), settings.multicastDiscovery},
+        {QStringLiteral("multicastGroup"), settings.multicastGroup},
+        {QStringLiteral("multicastTtl"), settings.multicastTtl},
+        {QStringLiteral("maxSessions"), settings.maxSessions},
+        {QStringLiteral("sessionIdleTimeout"), settings.sessionIdleTimeoutSeconds}
     };
 }
 
@@ -246,24 +269,114 @@ QJsonArray toJsonArray(const QStringList &list) {
 }
 } // namespace
 
-ChatController::ChatController(QObject *parent) : QObject(parent) {
+ChatController::ChatController(QObject *parent)
+    : QObject(parent),
+      m_router(new MessageRouter),
+      m_transfers(new FileTransferManager(m_router)),
+      m_rpc(new RpcChannel(m_router)) {
     qRegisterMetaType<PeerInfo>("PeerInfo");
+    qRegisterMetaType<PeerPresence>("PeerPresence");
     qRegisterMetaType<QList<SharedFileInfo>>("QList<SharedFileInfo>");
+    qRegisterMetaType<FileTransferStatus>("FileTransferStatus");
+    qRegisterMetaType<TransferCheckpoint>("TransferCheckpoint");
 
-    connect(&m_discovery, &DiscoveryService::peerDiscovered, &m_peerDirectory, &PeerDirectory::upsertPeer);
     connect(&m_discovery, &DiscoveryService::peerDiscovered, this, [this](const PeerInfo &info) {
-        if (m_storageReady) {
-            m_storage.upsertKnownPeer(info);
+        // 只有新联系人或内容变化才写库并同步给路由，普通心跳只记下出现时间，由定时器批量落盘。
+        if (m_peerDirectory.upsertPeer(info)) {
+            m_peerSightings.remove(info.id);
+            if (m_storageReady) {
+                m_storage.upsertKnownPeer(info);
+            }
+            runOnNetworkThread([router = m_router, info]() { router->rememberPeer(info); });
+        } else {
+            m_peerSightings.insert(info.id, info.lastSeen.toSecsSinceEpoch());
+        }
+        if (m_peersWithPendingUploads.contains(info.id)) {
+            resumePendingUploads(info);
+        }
+        if (outboxDue(info.id)) {
+            flushOutbox(info);
         }
     });
     connect(&m_discovery, &DiscoveryService::discoveryWarning, this, &ChatController::controllerWarning);
-    connect(&m_router, &MessageRouter::routerWarning, this, &ChatController::controllerWarning);
-    connect(&m_router, &MessageRouter::messageReceived, this, &ChatController::handleRouterMessage);
+    connect(&m_discovery, &DiscoveryService::peerPresenceChanged, this,
+            [this](const QString &peerId, PeerPresence, PeerPresence current) {
+                m_peerDirectory.setPresence(peerId, current);
+                if (m_outboxDueMs.contains(peerId)) {
+                    // 只为在线的联系人计时重发，上下线后重新计算定时器。
+                    scheduleOutboxRetry();
+                }
+                // 离开状态仍可能收到消息，只有离线才停止重连。
+                runOnNetworkThread([router = m_router, peerId, alive = current != PeerPresence::Offline]() {
+                    router->setPeerAlive(peerId, alive);
+                });
+            });
+
+    // 路由与文件传输在独立的网络线程中运行，套接字读写与帧解码不占用界面线程，
+    // 以下跨线程连接均为排队连接，界面线程只接收解码完成的消息。
+    m_networkThread.setObjectName(QStringLiteral("nwt-network"));
+    m_router->moveToThread(&m_networkThread);
+    m_transfers->moveToThread(&m_networkThread);
+    m_rpc->moveToThread(&m_networkThread);
+    connect(m_rpc, &RpcChannel::requestReceived, this, &ChatController::handleRpcRequest);
+    connect(m_rpc, &RpcChannel::replyReceived, this, &ChatController::handleRpcReply);
+    connect(m_rpc, &RpcChannel::callFailed, this, &ChatController::handleRpcFailure);
+    connect(m_router, &MessageRouter::routerWarning, this, &ChatController::controllerWarning);
+    connect(m_router, &MessageRouter::messageReceived, this, &ChatController::handleRouterMessage);
+    connect(m_router, &MessageRouter::clockEstimateUpdated, this,
+            [this](const QString &peerId, qint64 offsetMs, qint64) { m_peerClockOffsets.insert(peerId, offsetMs); });
+    connect(m_router, &MessageRouter::sessionClosed, this, [this](const QString &peerId) {
+        if (!m_storageReady) {
+            return;
+        }
+        // 文件传输模块先于本槽处理断线并保存检查点，此时查询即可得知是否有待续传的发送。
+        const QVector<TransferCheckpoint> checkpoints = m_storage.pendingTransfers(peerId);
+        for (const TransferCheckpoint &checkpoint : checkpoints) {
+            if (checkpoint.outgoing) {
+                m_peersWithPendingUploads.insert(peerId);
+                break;
+            }
+        }
+    });
+    connect(m_transfers, &FileTransferManager::transferStarted, this, &ChatController::handleTransferStarted);
+    connect(m_transfers, &FileTransferManager::transferProgress, this, &ChatController::fileTransferProgress);
+    connect(m_transfers, &FileTransferManager::transferFinished, this, &ChatController::handleTransferFinished);
+    connect(m_transfers, &FileTransferManager::checkpointUpdated, this, [this](const TransferCheckpoint &checkpoint) {
+        if (m_storageReady) {
+            m_storage.upsertTransfer(checkpoint);
+        }
+    });
+    connect(m_transfers, &FileTransferManager::checkpointDiscarded, this, [this](const QString &transferId) {
+        if (m_storageReady) {
+            m_storage.removeTransfer(transferId);
+        }
+    });
+    m_outboxTimer.setSingleShot(true);
+    connect(&m_outboxTimer, &QTimer::timeout, this, &ChatController::retryDueOutboxes);
+    m_peerSightingTimer.setInterval(PeerSightingFlushMs);
+    connect(&m_peerSightingTimer, &QTimer::timeout, this, &ChatController::flushPeerSightings);
+    m_peerSightingTimer.start();
+    m_networkThread.start();
 }
 
 ChatController::~ChatController() {
+    flushPeerSightings();
     m_discovery.stop();
-    m_router.stop();
+    // 网络线程上的对象带有定时器与套接字，必须在所属线程中析构，之后再结束线程。
+    QMetaObject::invokeMethod(
+        m_router,
+        [rpc = m_rpc, transfers = m_transfers, router = m_router]() {
+            router->stop();
+            delete rpc;
+            delete transfers;
+            delete router;
+        },
+        Qt::BlockingQueuedConnection);
+    m_rpc = nullptr;
+    m_transfers = nullptr;
+    m_router = nullptr;
+    m_networkThread.quit();
+    m_networkThread.wait();
 }
 
 bool ChatController::initialize() {
@@ -274,23 +387,41 @@ bool ChatController::initialize() {
     }
     loadSettings();
     loadKnownPeers();
+    loadPendingTransfers();
+    loadOutbox();
     initializeRoles();
     if (m_settings.activeRoleId.isEmpty() && !m_roles.isEmpty()) {
         m_settings.activeRoleId = m_roles.front().id;
     }
 
-    if (!m_router.startListening(m_listenPort)) {
+    bool listening = false;
+    const quint16 port = m_listenPort;
+    QMetaObject::invokeMethod(
+        m_router, [router = m_router, port]() { return router->startListening(port); },
+        Qt::BlockingQueuedConnection, &listening);
+    if (!listening) {
         emit controllerWarning(
             LanguageManager::text(LangKey::Controller::RouterFailed, QStringLiteral("消息路由启动失败")));
     }
-    m_router.setLocalPeerId(m_localId);
-    m_router.setLocalDisplayName(m_displayName);
+    QString localEndpoint;
+    QMetaObject::invokeMethod(
+        m_router, [router = m_router]() { return router->localEndpoint(); }, Qt::BlockingQueuedConnection,
+        &localEndpoint);
+    runOnNetworkThread([router = m_router, id = m_localId, name = m_displayName]() {
+        router->setLocalPeerId(id);
+        router->setLocalDisplayName(name);
+        router->setWriteBatching(true);
+    });
+    applySessionLimits();
 
     m_discovery.setLocalIdentity(m_localId, m_displayName, m_listenPort);
+    m_discovery.setLocalCapabilities(MessageRouter::localCapabilities());
+    m_discovery.setLocalEndpoint(MessageRouter::hostIdentity(), localEndpoint);
+    m_discovery.setProfileVersion(profileVersion());
     m_discovery.setSubnets(m_subnets);
     m_discovery.setBlockedSubnets(m_blockedSubnets);
+    applyMulticastSettings();
     m_discovery.start();
-    m_discovery.announceOnline();
 
     const QString readyText =
         LanguageManager::text(LangKey::Controller::StartupReady, QStringLiteral("启动完成，ID: %1 端口: %2"))
@@ -301,6 +432,118 @@ bool ChatController::initialize() {
     return true;
 }
 
+void ChatController::loadPendingTransfers() {
+    if (!m_storageReady) {
+        return;
+    }
+    const QVector<TransferCheckpoint> checkpoints = m_storage.pendingTransfers();
+    runOnNetworkThread([transfers = m_transfers, checkpoints]() { transfers->restoreIncoming(checkpoints); });
+    for (const TransferCheckpoint &checkpoint : checkpoints) {
+        if (checkpoint.outgoing) {
+            m_peersWithPendingUploads.insert(checkpoint.peerId);
+        }
+    }
+}
+
+void ChatController::loadOutbox() {
+    if (!m_storageReady) {
+        return;
+    }
+    m_storage.pruneReceivedMessages(QDateTime::currentSecsSinceEpoch() - ReceivedMessageRetentionSeconds);
+    const QVector<QString> peerIds = m_storage.outboxPeerIds();
+    for (const QString &peerId : peerIds) {
+        // 上次运行遗留的消息立即到期，联系人出现时即重发。
+        m_outboxDueMs.insert(peerId, 0);
+    }
+}
+
+bool ChatController::outboxDue(const QString &peerId) const {
+    const auto due = m_outboxDueMs.constFind(peerId);
+    return due != m_outboxDueMs.constEnd() && due.value() <= QDateTime::currentMSecsSinceEpoch();
+}
+
+void ChatController::flushOutbox(const PeerInfo &peer) {
+    if (!m_storageReady || !outboxDue(peer.id)) {
+        return;
+    }
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    const QVector<OutboxMessage> batch = m_storage.pendingOutbox(peer.id, now - OutboxRetrySeconds, OutboxBatchSize);
+    if (!batch.isEmpty()) {
+        QStringList messageIds;
+        for (const OutboxMessage &message : batch) {
+            messageIds.append(message.messageId);
+        }
+        m_storage.markOutboxAttempted(messageIds, now);
+        runOnNetworkThread([router = m_router, peer, batch]() {
+            for (const OutboxMessage &message : batch) {
+                router->sendChatMessage(peer, message.text, QString(), message.roleName, message.messageId,
+                                        QDateTime::fromMSecsSinceEpoch(message.createdAt, Qt::UTC));
+            }
+        });
+    }
+    if (batch.size() == OutboxBatchSize) {
+        // 已发出的消息更新了发送时间，下一批查询自然从后续消息开始。
+        m_outboxDueMs.insert(peer.id, QDateTime::currentMSecsSinceEpoch() + OutboxBatchIntervalMs);
+    } else {
+        // 剩余消息都是刚发出、确认尚在途中的，最早的一条超时未确认时再检查（查询条件为严格早于，多留一秒）；
+        // 发件箱已清空则不再检查该联系人。
+        const qint64 earliest = m_storage.earliestOutboxAttempt(peer.id);
+        if (earliest < 0) {
+            m_outboxDueMs.remove(peer.id);
+        } else {
+            m_outboxDueMs.insert(peer.id, (earliest + OutboxRetrySeconds + 1) * 1000);
+        }
+    }
+    scheduleOutboxRetry();
+}
+
+void ChatController::scheduleOutboxRetry() {
+    qint64 next = std::numeric_limits<qint64>::max();
+    for (auto it = m_outboxDueMs.cbegin(); it != m_outboxDueMs.cend(); ++it) {
+        if (m_discovery.presenceOf(it.key()) != PeerPresence::Offline) {
+            next = qMin(next, it.value());
+        }
+    }
+    if (next == std::numeric_limits<qint64>::max()) {
+        m_outboxTimer.stop();
+        return;
+    }
+    const qint64 delay = qBound<qint64>(0, next - QDateTime::currentMSecsSinceEpoch(), OutboxRetrySeconds * 1000);
+    m_outboxTimer.start(static_cast<int>(delay));
+}
+
+void ChatController::retryDueOutboxes() {
+    QStringList due;
+    for (auto it = m_outboxDueMs.cbegin(); it != m_outboxDueMs.cend(); ++it) {
+        if (outboxDue(it.key()) && m_discovery.presenceOf(it.key()) != PeerPresence::Offline) {
+            due.append(it.key());
+        }
+    }
+    for (const QString &peerId : std::as_const(due)) {
+        const PeerInfo peer = findPeer(peerId);
+        if (peer.id.isEmpty()) {
+            m_outboxDueMs.remove(peerId);
+        } else {
+            flushOutbox(peer);
+        }
+    }
+    scheduleOutboxRetry();
+}
+
+void ChatController::resumePendingUploads(const PeerInfo &peer) {
+    m_peersWithPendingUploads.remove(peer.id);
+    if (!m_storageReady || !peer.supports(PeerCapability::ChunkedTransfer)) {
+        return;
+    }
+    const QVector<TransferCheckpoint> checkpoints = m_storage.pendingTransfers(peer.id);
+    for (const TransferCheckpoint &checkpoint : checkpoints) {
+        if (checkpoint.outgoing) {
+            runOnNetworkThread(
+                [transfers = m_transfers, peer, checkpoint]() { transfers->resumeUpload(peer, checkpoint); });
+        }
+    }
+}
+
 PeerDirectory *ChatController::peerDirectory() {
     return &m_peerDirectory;
 }
@@ -343,6 +586,28 @@ QVector<QString> ChatController::recentPeerIds(int limit) const {
     return m_storage.recentPeerIds(limit);
 }
 
+void ChatController::applyMulticastSettings() {
+    const NetworkSettings &network = m_settings.network;
+    m_discovery.setMulticast(network.multicastDiscovery, QHostAddress(network.multicastGroup), network.multicastTtl,
+                             network.bindNetworkInterface ? network.boundInterfaceId : QString());
+}
+
+void ChatController::applySessionLimits() {
+    const NetworkSettings &network = m_settings.network;
+    runOnNetworkThread([router = m_router, maxSessions = network.maxSessions,
+                        idleSeconds = network.sessionIdleTimeoutSeconds]() {
+        router->setSessionLimits(maxSessions, idleSeconds);
+    });
+}
+
+void ChatController::flushPeerSightings() {
+    if (!m_storageReady || m_peerSightings.isEmpty()) {
+        return;
+    }
+    m_storage.touchKnownPeers(m_peerSightings);
+    m_peerSightings.clear();
+}
+
 void ChatController::loadKnownPeers() {
     if (!m_storageReady) {
         return;
@@ -351,6 +616,7 @@ void ChatController::loadKnownPeers() {
     for (const PeerInfo &peer : peers) {
         m_peerDirectory.upsertPeer(peer);
     }
+    m_discovery.setExpectedPopulation(peers.size());
 }
 
 QVector<RoleProfile> ChatController::availableRoles() const {
@@ -374,7 +640,28 @@ void ChatController::sendMessageToPeer(const QString &peerId, const QString &tex
     }
     const ProfileDetails profile = m_settings.profile;
     const QString roleName = profile.name.isEmpty() ? m_displayName : profile.name;
-    m_router.sendChatMessage(peer, text, QString(), roleName);
+    QString messageId;
+    QDateTime sentAt;
+    if (m_storageReady && peer.supports(PeerCapability::DeliveryAck)) {
+        // 消息先写入发件箱再发送，对端确认前一直保留，对端离线时待其重新上线后重发。
+        OutboxMessage message;
+        message.messageId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+        message.peerId = peer.id;
+        message.roleName = roleName;
+        message.text = text;
+        message.createdAt = QDateTime::currentMSecsSinceEpoch();
+        m_storage.enqueueOutbox(message, message.createdAt / 1000);
+        if (!m_outboxDueMs.contains(peer.id)) {
+            m_outboxDueMs.insert(peer.id, message.createdAt + OutboxRetrySeconds * 1000);
+            scheduleOutboxRetry();
+        }
+        messageId = message.messageId;
+        sentAt = QDateTime::fromMSecsSinceEpoch(message.createdAt, Qt::UTC);
+    }
+    // 首次发送与重发使用同一时间戳，接收端看到的顺序不因重发而改变。
+    runOnNetworkThread([router = m_router, peer, text, roleName, messageId, sentAt]() {
+        router->sendChatMessage(peer, text, QString(), roleName, messageId, sentAt);
+    });
     recordChatHistory(peer.id, roleName, text, MessageDirection::Outgoing, QStringLiteral("chat"));
 }
 
@@ -385,7 +672,35 @@ void ChatController::sendFileToPeer(const QString &peerId, const QString &filePa
             LanguageManager::text(LangKey::Controller::PeerMissing, QStringLiteral("未找到联系人 %1")).arg(peerId));
         return;
     }
+    startFileTransfer(peer, filePath, QString());
+}
+
+bool ChatController::startFileTransfer(const PeerInfo &peer, const QString &filePath, const QString &transferId) {
+    const RoleProfile profile = activeRole();
+    const QString roleName = profile.id.isEmpty() ? m_displayName : profile.name;
+    if (!peer.supports(PeerCapability::ChunkedTransfer)) {
+        sendLegacyFile(peer, filePath);
+        return true;
+    }
+
+    const QFileInfo info(filePath);
+    if (!info.isFile() || !info.isReadable()) {
+        emit controllerWarning(
+            LanguageManager::text(LangKey::Controller::CannotReadFile, QStringLiteral("无法读取文件: %1"))
+                .arg(filePath));
+        return false;
+    }
+    runOnNetworkThread([transfers = m_transfers, peer, filePath, roleId = profile.id, roleName, transferId]() {
+        transfers->startUpload(peer, filePath, roleId, roleName, transferId);
+    });
+    recordChatHistory(peer.id, roleName, QFileInfo(filePath).fileName(), MessageDirection::Outgoing,
+                      QStringLiteral("file"), filePath);
+    return true;
+}
 
+void ChatController::sendLegacyFile(const PeerInfo &peer, const QString &filePath) {
+    // 旧版客户端只认识整文件 base64 的 file 消息，仅对不超过上限的小文件保留该路径。
+    constexpr qint64 LegacyFileLimit = 32 * 1024 * 1024;
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
         emit controllerWarning(
@@ -393,6 +708,12 @@ void ChatController::sendFileToPeer(const QString &peerId, const QString &filePa
                 .arg(file.errorString()));
         return;
     }
+    if (file.size() > LegacyFileLimit) {
+        emit controllerWarning(LanguageManager::text(LangKey::Controller::PeerTransferUnsupported,
+                                                     QStringLiteral("对方客户端版本过旧，无法接收大于 %1 MB 的文件"))
+                                   .arg(LegacyFileLimit / (1024 * 1024)));
+        return;
+    }
 
     const QByteArray data = file.readAll();
     QJsonObject payload{
@@ -402,13 +723,26 @@ void ChatController::sendFileToPeer(const QString &peerId, const QString &filePa
     };
     const RoleProfile profile = activeRole();
     const QString roleName = profile.id.isEmpty() ? m_displayName : profile.name;
-    m_router.sendFilePayload(peer, profile.id, roleName, payload);
+    runOnNetworkThread([router = m_router, peer, roleId = profile.id, roleName, payload]() {
+        router->sendFilePayload(peer, roleId, roleName, payload);
+    });
     emit statusInfo(
         LanguageManager::text(LangKey::Controller::FileSent, QStringLiteral("已发送文件 %1")).arg(file.fileName()));
     recordChatHistory(peer.id, roleName, QFileInfo(file).fileName(), MessageDirection::Outgoing,
                       QStringLiteral("file"), filePath);
 }
 
+void ChatController::requestTransportStats() {
+    runOnNetworkThread([this, router = m_router]() {
+        const QVector<MessageRouter::SessionStats> stats = router->sessionStats();
+        const MessageRouter::WriteStats writes = router->writeStats();
+        const MessageRouter::PoolStats pool = router->poolStats();
+        QMetaObject::invokeMethod(
+            this, [this, stats, writes, pool]() { emit transportStatsReady(stats, writes, pool); },
+            Qt::QueuedConnection);
+    });
+}
+
 void ChatController::requestPeerShareList(const QString &peerId) {
     const PeerInfo peer = findPeer(peerId);
     if (peer.id.isEmpty()) {
@@ -416,8 +750,17 @@ void ChatController::requestPeerShareList(const QString &peerId) {
             LanguageManager::text(LangKey::Controller::PeerMissing, QStringLiteral("未找到联系人 %1")).arg(peerId));
         return;
     }
+    if (peer.supports(PeerCapability::Rpc)) {
+        for (const auto &call : std::as_const(m_pendingCalls)) {
+            if (call.first == peer.id && call.second == QStringLiteral("share.list")) {
+                return;
+            }
+        }
+        callPeer(peer, QStringLiteral("share.list"));
+        return;
+    }
     QJsonObject payload{{QStringLiteral("type"), QStringLiteral("share_request")}};
-    m_router.sendSharePayload(peer, payload);
+    runOnNetworkThread([router = m_router, peer, payload]() { router->sendSharePayload(peer, payload); });
 }
 
 void ChatController::requestPeerSharedFile(const QString &peerId, const QString &entryId) {
@@ -427,11 +770,154 @@ void ChatController::requestPeerSharedFile(const QString &peerId, const QString
             LanguageManager::text(LangKey::Controller::PeerMissing, QStringLiteral("未找到联系人 %1")).arg(peerId));
         return;
     }
+    if (peer.supports(PeerCapability::Rpc)) {
+        callPeer(peer, QStringLiteral("share.download"), QJsonObject{{QStringLiteral("entryId"), entryId}});
+        return;
+    }
     QJsonObject payload{
         {QStringLiteral("type"), QStringLiteral("share_download")},
         {QStringLiteral("entryId"), entryId}
     };
-    m_router.sendSharePayload(peer, payload);
+    runOnNetworkThread([router = m_router, peer, payload]() { router->sendSharePayload(peer, payload); });
+}
+
+void ChatController::requestPeerProfile(const QString &peerId) {
+    const PeerInfo peer = findPeer(peerId);
+    if (peer.id.isEmpty() || !peer.supports(PeerCapability::Rpc)) {
+        return;
+    }
+    const auto cached = m_peerProfiles.constFind(peerId);
+    if (cached != m_peerProfiles.constEnd() && peer.profileDigest != 0 && cached->first == peer.profileDigest) {
+        emit peerProfileReceived(peerId, cached->second);
+        return;
+    }
+    callPeer(peer, QStringLiteral("profile.get"));
+}
+
+void ChatController::cancelPeerRequests(const QString &peerId) {
+    QList<quint64> cancelled;
+    for (auto it = m_pendingCalls.cbegin(); it != m_pendingCalls.cend(); ++it) {
+        if (it->first == peerId) {
+            cancelled.append(it.key());
+        }
+    }
+    for (const quint64 requestId : std::as_const(cancelled)) {
+        m_pendingCalls.remove(requestId);
+    }
+    if (!cancelled.isEmpty()) {
+        runOnNetworkThread([rpc = m_rpc, cancelled]() {
+            for (const quint64 requestId : cancelled) {
+                rpc->cancel(requestId);
+            }
+        });
+    }
+}
+
+void ChatController::callPeer(const PeerInfo &peer, const QString &method, const QJsonObject &params) {
+    const quint64 requestId = m_rpc->reserveRequestId();
+    m_pendingCalls.insert(requestId, qMakePair(peer.id, method));
+    runOnNetworkThread([rpc = m_rpc, peer, requestId, method, params]() { rpc->call(peer, requestId, method, params); });
+}
+
+void ChatController::handleRpcRequest(const PeerInfo &peer, const QString &rpcId, const QString &method,
+                                      const QJsonObject &params) {
+    QJsonObject result;
+    QString error;
+    if (method == QStringLiteral("share.list")) {
+        result.insert(QStringLiteral("files"), localShareArray());
+    } else if (method == QStringLiteral("share.download")) {
+        const QString entryId = params.value(QStringLiteral("entryId")).toString();
+        // 传输 ID 由本端预先分配并随应答返回，请求方据此认出随后到达的传输邀请。
+        const QString transferId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+        if (entryId.isEmpty() || !m_shareManager.hasLocalEntry(entryId) ||
+            !startFileTransfer(peer, m_shareManager.localEntry(entryId).filePath, transferId)) {
+            // 条目失效由请求方提示，本端不再弹出警告。
+            error = QStringLiteral("share_missing");
+        } else {
+            result.insert(QStringLiteral("transferId"), transferId);
+        }
+    } else if (method == QStringLiteral("profile.get")) {
+        result = profileToJson(m_settings.profile);
+    } else {
+        error = QStringLiteral("unknown_method");
+    }
+    const QString peerId = peer.id;
+    runOnNetworkThread([rpc = m_rpc, peerId, rpcId, result, error]() {
+        if (error.isEmpty()) {
+            rpc->reply(peerId, rpcId, result);
+        } else {
+            rpc->replyError(peerId, rpcId, error);
+        }
+    });
+}
+
+void ChatController::handleRpcReply(const QString &peerId, quint64 requestId, const QJsonObject &result) {
+    const auto call = m_pendingCalls.constFind(requestId);
+    if (call == m_pendingCalls.constEnd()) {
+        return;
+    }
+    const QString method = call->second;
+    m_pendingCalls.erase(call);
+    if (method == QStringLiteral("share.list")) {
+        const QList<SharedFileInfo> files = parseShareArray(result.value(QStringLiteral("files")).toArray());
+        m_shareManager.updateRemoteCatalog(peerId, files);
+        emit shareCatalogReceived(peerId, files);
+    } else if (method == QStringLiteral("profile.get")) {
+        const PeerInfo peer = findPeer(peerId);
+        const ProfileDetails details = parseProfileObject(result, peer.displayName, QString());
+        m_peerProfiles.insert(peerId, qMakePair(peer.profileDigest, details));
+        emit peerProfileReceived(peerId, details);
+    } else if (method == QStringLiteral("share.download")) {
+        const QString transferId = result.value(QStringLiteral("transferId")).toString();
+        if (transferId.isEmpty()) {
+            return;
+        }
+        // 传输邀请可能先于应答到达：已开始的接收直接认领，否则等邀请到达时再匹配。
+        const auto started = m_unclaimedIncoming.constFind(transferId);
+        if (started != m_unclaimedIncoming.constEnd() && started->first == peerId) {
+            const QString fileName = started->second;
+            m_unclaimedIncoming.erase(started);
+            announceShareDownload(peerId, fileName);
+        } else {
+            m_shareDownloads.insert(transferId, peerId);
+        }
+    }
+}
+
+void ChatController::handleTransferStarted(const FileTransferStatus &status) {
+    emit fileTransferStarted(status);
+    if (status.outgoing) {
+        return;
+    }
+    const auto requested = m_shareDownloads.constFind(status.transferId);
+    if (requested != m_shareDownloads.constEnd() && requested.value() == status.peerId) {
+        m_shareDownloads.erase(requested);
+        announceShareDownload(status.peerId, status.fileName);
+        return;
+    }
+    m_unclaimedIncoming.insert(status.transferId, qMakePair(status.peerId, status.fileName));
+}
+
+void ChatController::announceShareDownload(const QString &peerId, const QString &fileName) {
+    const PeerInfo peer = findPeer(peerId);
+    emit statusInfo(LanguageManager::text(LangKey::Controller::ShareDownloadStarted,
+                                          QStringLiteral("开始下载 %1 共享的文件 %2"))
+                        .arg(peer.displayName.isEmpty() ? peerId : peer.displayName, fileName));
+}
+
+void ChatController::handleRpcFailure(const QString &peerId, quint64 requestId, const QString &error) {
+    if (!m_pendingCalls.remove(requestId)) {
+        return;
+    }
+    if (error == QStringLiteral("share_missing")) {
+        emit controllerWarning(
+            LanguageManager::text(LangKey::Controller::ShareMissing, QStringLiteral("共享条目不存在或已失效")));
+        return;
+    }
+    const PeerInfo peer = findPeer(peerId);
+    emit controllerWarning(
+        LanguageManager::text(LangKey::Controller::RequestFailed, QStringLiteral("向 %1 发起的请求失败：%2"))
+            .arg(peer.displayName.isEmpty() ? peerId : peer.displayName, error));
 }
 
 void ChatController::shareCatalogToPeer(const QString &peerId) {
@@ -526,7 +1012,18 @@ void ChatController::updateGeneralSettings(const GeneralSettings &settings) {
 }
 
 void ChatController::updateNetworkSettings(const NetworkSettings &settings) {
+    const NetworkSettings previous = m_settings.network;
     m_settings.network = settings;
+    if (previous.multicastDiscovery != settings.multicastDiscovery ||
+        previous.multicastGroup != settings.multicastGroup || previous.multicastTtl != settings.multicastTtl ||
+        previous.bindNetworkInterface != settings.bindNetworkInterface ||
+        previous.boundInterfaceId != settings.boundInterfaceId) {
+        applyMulticastSettings();
+    }
+    if (previous.maxSessions != settings.maxSessions ||
+        previous.sessionIdleTimeoutSeconds != settings.sessionIdleTimeoutSeconds) {
+        applySessionLimits();
+    }
     persistSettings();
     emit preferencesChanged(m_settings);
 }
@@ -587,10 +1084,25 @@ void ChatController::updateProfileDetails(const ProfileDetails &details) {
     }
     m_settings.signatureText = updated.signature;
     persistSettings();
+    // 资料摘要随之变化，联系人据此重新获取资料。
+    m_discovery.setLocalIdentity(m_localId, m_displayName, m_listenPort);
+    m_discovery.setProfileVersion(profileVersion());
+    m_discovery.announceOnline();
     emit profileUpdated(updated);
     emit preferencesChanged(m_settings);
 }
 
+QByteArray ChatController::profileVersion() const {
+    QByteArray version = QJsonDocument(profileToJson(m_settings.profile)).toJson(QJsonDocument::Compact);
+    // 头像只取路径、大小与修改时间，不读取图片内容。
+    const QFileInfo avatar(m_settings.profile.avatarPath);
+    if (avatar.exists()) {
+        version += avatar.absoluteFilePath().toUtf8() + QByteArray::number(avatar.size()) +
+                   QByteArray::number(avatar.lastModified().toMSecsSinceEpoch());
+    }
+    return version;
+}
+
 QString ChatController::dataDirectoryPath() const {
     QString baseDir = QCoreApplication::applicationDirPath();
     QDir dir(baseDir);
@@ -689,7 +1201,7 @@ void ChatController::loadSettings() {
 
 void ChatController::recordChatHistory(const QString &peerId, const QString &roleName, const QString &content,
                                        MessageDirection direction, const QString &messageType,
-                                       const QString &attachmentPath) {
+                                       const QString &attachmentPath, qint64 timestamp) {
     if (!m_storageReady) {
         return;
     }
@@ -700,7 +1212,7 @@ void ChatController::recordChatHistory(const QString &peerId, const QString &rol
     message.attachmentPath = attachmentPath;
     message.direction = direction;
     message.messageType = messageType;
-    message.timestamp = QDateTime::currentSecsSinceEpoch();
+    message.timestamp = timestamp > 0 ? timestamp : QDateTime::currentSecsSinceEpoch();
     m_storage.storeMessage(message);
 }
 
@@ -718,6 +1230,26 @@ void ChatController::persistSettings() {
     m_storage.saveState(state);
 }
 
+qint64 ChatController::senderTimestamp(const QString &peerId, const QJsonObject &payload) const {
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    const auto offset = m_peerClockOffsets.constFind(peerId);
+    // timestamp 为毫秒级 Unix 时间；旧版本发来的 ISO 字符串仍然兼容。
+    const QJsonValue stamp = payload.value(QStringLiteral("timestamp"));
+    qint64 sentMs = 0;
+    if (stamp.isDouble()) {
+        sentMs = static_cast<qint64>(stamp.toDouble());
+    } else {
+        const QDateTime sentAt = QDateTime::fromString(stamp.toString(), Qt::ISODate);
+        sentMs = sentAt.isValid() ? sentAt.toMSecsSinceEpoch() : 0;
+    }
+    if (offset == m_peerClockOffsets.constEnd() || sentMs <= 0) {
+        return now;
+    }
+    // 发送方时间按估计的时钟偏差换算到本机时钟，早于接收时刻才采用，避免偏差误差把消息排到未来。
+    const qint64 local = (sentMs - offset.value()) / 1000;
+    return qMin(local, now);
+}
+
 PeerInfo ChatController::findPeer(const QString &peerId) const {
     for (const auto &peer : m_peerDirectory.peers()) {
         if (peer.id == peerId) {
@@ -750,10 +1282,24 @@ RoleProfile ChatController::roleById(const QString &roleId) const {
 void ChatController::handleRouterMessage(const PeerInfo &peer, const QJsonObject &payload) {
     const QString type = payload.value(QStringLiteral("type")).toString();
     if (type == QStringLiteral("chat")) {
+        const QString messageId = payload.value(QStringLiteral("messageId")).toString();
+        if (!messageId.isEmpty()) {
+            // 重复收到也要确认：上一次的确认可能在途中丢失，发送方据此才能清除发件箱。
+            runOnNetworkThread([router = m_router, peer, messageId]() { router->sendDeliveryAck(peer, messageId); });
+            if (m_storageReady && !m_storage.recordReceivedMessage(peer.id, messageId)) {
+                return;
+            }
+        }
         const QString roleName = payload.value(QStringLiteral("roleName")).toString(peer.displayName);
         const QString text = payload.value(QStringLiteral("text")).toString();
-        recordChatHistory(peer.id, roleName, text, MessageDirection::Incoming, QStringLiteral("chat"));
+        recordChatHistory(peer.id, roleName, text, MessageDirection::Incoming, QStringLiteral("chat"), QString(),
+                          senderTimestamp(peer.id, payload));
         emit chatMessageReceived(peer, roleName, text);
+    } else if (type == QStringLiteral("chat_ack")) {
+        // 只接受收件人本人的确认，其他联系人伪造或误发的确认不能让消息提前出队。
+        if (m_storageReady) {
+            m_storage.removeOutbox(peer.id, payload.value(QStringLiteral("messageId")).toString());
+        }
     } else if (type == QStringLiteral("file")) {
         handleFileMessage(peer, payload);
     } else if (type == QStringLiteral("share_request")) {
@@ -788,9 +1334,44 @@ void ChatController::handleFileMessage(const PeerInfo &peer, const QJsonObject &
     recordChatHistory(peer.id, roleName, fileName, MessageDirection::Incoming, QStringLiteral("file"), localPath);
 }
 
+void ChatController::handleTransferFinished(const FileTransferStatus &status, bool success,
+                                            const QString &errorString) {
+    m_unclaimedIncoming.remove(status.transferId);
+    m_shareDownloads.remove(status.transferId);
+    emit fileTransferFinished(status, success);
+    if (!success) {
+        emit controllerWarning(LanguageManager::text(LangKey::Controller::FileTransferFailed,
+                                                     QStringLiteral("文件 %1 传输失败: %2"))
+                                   .arg(status.fileName, errorString));
+        return;
+    }
+    if (status.outgoing) {
+        emit statusInfo(
+            LanguageManager::text(LangKey::Controller::FileSent, QStringLiteral("已发送文件 %1")).arg(status.fileName));
+        return;
+    }
+
+    const PeerInfo known = findPeer(status.peerId);
+    PeerInfo peer = known;
+    if (peer.id.isEmpty()) {
+        peer.id = status.peerId;
+        peer.displayName = status.peerId;
+    }
+    emit fileReceived(peer, status.roleName, status.fileName, status.localPath);
+    emit statusInfo(LanguageManager::text(LangKey::Controller::FileSaved, QStringLiteral("已保存来自 %1 的文件 %2"))
+                        .arg(peer.displayName, status.fileName));
+    recordChatHistory(peer.id, status.roleName, status.fileName, MessageDirection::Incoming, QStringLiteral("file"),
+                      status.localPath);
+}
+
 void ChatController::handleShareCatalog(const PeerInfo &peer, const QJsonObject &payload) {
+    const QList<SharedFileInfo> files = parseShareArray(payload.value(QStringLiteral("files")).toArray());
+    m_shareManager.updateRemoteCatalog(peer.id, files);
+    emit shareCatalogReceived(peer.id, files);
+}
+
+QList<SharedFileInfo> ChatController::parseShareArray(const QJsonArray &array) const {
     QList<SharedFileInfo> files;
-    const QJsonArray array = payload.value(QStringLiteral("files")).toArray();
     for (const QJsonValue &value : array) {
         const QJsonObject entry = value.toObject();
         SharedFileInfo info;
@@ -799,8 +1380,7 @@ void ChatController::handleShareCatalog(const PeerInfo &peer, const QJsonObject
         info.size = static_cast<quint64>(entry.value(QStringLiteral("size")).toDouble());
         files.append(info);
     }
-    m_shareManager.updateRemoteCatalog(peer.id, files);
-    emit shareCatalogReceived(peer.id, files);
+    return files;
 }
 
 void ChatController::handleShareRequest(const PeerInfo &peer, const QJsonObject &) {
@@ -821,7 +1401,7 @@ void ChatController::handleShareDownload(const PeerInfo &peer, const QJsonObject
     sendFileToPeer(peer.id, info.filePath);
 }
 
-void ChatController::sendShareCatalogToPeer(const PeerInfo &peer) {
+QJsonArray ChatController::localShareArray() {
     const QList<SharedFileInfo> files = m_shareManager.collectLocalShares(m_settings.sharedDirectories);
     QJsonArray array;
     for (const SharedFileInfo &info : files) {
@@ -831,11 +1411,15 @@ void ChatController::sendShareCatalogToPeer(const PeerInfo &peer) {
             {QStringLiteral("size"), static_cast<double>(info.size)}
         });
     }
+    return array;
+}
+
+void ChatController::sendShareCatalogToPeer(const PeerInfo &peer) {
     QJsonObject payload{
         {QStringLiteral("type"), QStringLiteral("share_catalog")},
-        {QStringLiteral("files"), array}
+        {QStringLiteral("files"), localShareArray()}
     };
-    m_router.sendSharePayload(peer, payload);
+    runOnNetworkThread([router = m_router, peer, payload]() { router->sendSharePayload(peer, payload); });
 }
 
 ProfileDetails ChatController::parseProfileObject(const QJsonObject &object, const QString &nameFallback,
@@ -1,20 +1,28 @@
 #pragma once
 
 #include "DiscoveryService.h"
+#include "FileTransferManager.h"
 #include "MessageRouter.h"
 #include "PeerDirectory.h"
+#include "RpcChannel.h"
 #include "StorageManager.h"
 #include "SettingsTypes.h"
 #include "ShareManager.h"
 
 #include <QHostAddress>
 #include <QHash>
+#include <QJsonArray>
 #include <QJsonObject>
 #include <QList>
 #include <QPair>
+#include <QSet>
 #include <QStringList>
+#include <QThread>
+#include <QTimer>
 #include <QVector>
 
+#include <utility>
+
 class ChatController : public QObject {
     Q_OBJECT
 
@@ -46,8 +54,19 @@ public:
 public slots:
     void sendMessageToPeer(const QString &peerId, const QString &text);
     void sendFileToPeer(const QString &peerId, const QString &filePath);
+    /*!
+     * \brief requestPeerShareList 请求联系人的共享目录；对端支持 rpc/1 时以带 ID 的请求发出，同一联系人的目录请求在途时不重复发送。
+     */
     void requestPeerShareList(const QString &peerId);
     void requestPeerSharedFile(const QString &peerId, const QString &entryId);
+    /*!
+     * \brief requestPeerProfile 获取联系人的个人资料，结果通过 peerProfileReceived 返回。
+     */
+    void requestPeerProfile(const QString &peerId);
+    /*!
+     * \brief cancelPeerRequests 取消发往该联系人且仍在等待应答的全部请求。
+     */
+    void cancelPeerRequests(const QString &peerId);
     void shareCatalogToPeer(const QString &peerId);
     void addSubnet(const QHostAddress &network, int prefixLength);
     void setSubnets(const QList<QPair<QHostAddress, int>> &subnets);
@@ -62,43 +81,109 @@ public slots:
     void updateSharedDirectories(const QStringList &directories);
     void updateSignatureText(const QString &signature);
     void updateProfileDetails(const ProfileDetails &details);
+    /*!
+     * \brief requestTransportStats 在网络线程中采集各会话的传输统计与发送与连接池汇总，结果通过 transportStatsReady 返回。
+     */
+    void requestTransportStats();
 
 signals:
     void chatMessageReceived(const PeerInfo &peer, const QString &roleName, const QString &text);
     void fileReceived(const PeerInfo &peer, const QString &roleName, const QString &fileName, const QString &localPath);
     void shareCatalogReceived(const QString &peerId, const QList<SharedFileInfo> &files);
+    void peerProfileReceived(const QString &peerId, const ProfileDetails &details);
     void statusInfo(const QString &text);
     void controllerWarning(const QString &message);
     void preferencesChanged(const AppSettings &settings);
     void roleChanged(const RoleProfile &profile);
     void profileUpdated(const ProfileDetails &details);
+    /*!
+     * \brief 文件传输开始、进度推进与结束时触发，供界面展示传输进度。
+     */
+    void fileTransferStarted(const FileTransferStatus &status);
+    void fileTransferProgress(const FileTransferStatus &status);
+    void fileTransferFinished(const FileTransferStatus &status, bool success);
+    void transportStatsReady(const QVector<MessageRouter::SessionStats> &stats, const MessageRouter::WriteStats &writes,
+                             const MessageRouter::PoolStats &pool);
 
 private:
     QString dataDirectoryPath() const;
     QString databaseFilePath() const;
     QString avatarDirectoryPath() const;
     QString storeAvatarImage(const QString &sourcePath) const;
+    QByteArray profileVersion() const;
     void loadSettings();
     void loadKnownPeers();
+    void flushPeerSightings();
+    void applyMulticastSettings();
+    void applySessionLimits();
+    void loadPendingTransfers();
+    void loadOutbox();
+    /*!
+     * \brief flushOutbox 联系人在线时分批重发发件箱中超时未确认的消息，接收端按消息 ID 去重；
+     *        结束后按剩余消息的发送时间记下该联系人下一次到期的时刻。
+     */
+    void flushOutbox(const PeerInfo &peer);
+    /*!
+     * \brief scheduleOutboxRetry 按在线联系人中最早到期的发件箱启动重发定时器，没有到期项时停止。
+     */
+    void scheduleOutboxRetry();
+    void retryDueOutboxes();
+    bool outboxDue(const QString &peerId) const;
+    /*!
+     * \brief runOnNetworkThread 将调用投递到网络线程执行，路由与文件传输对象只能在该线程内访问。
+     */
+    template <typename Function>
+    void runOnNetworkThread(Function &&function) {
+        QMetaObject::invokeMethod(m_router, std::forward<Function>(function), Qt::QueuedConnection);
+    }
+    /*!
+     * \brief resumePendingUploads 联系人重新上线后，按持久化检查点续传此前中断的发送。
+     */
+    void resumePendingUploads(const PeerInfo &peer);
     void recordChatHistory(const QString &peerId, const QString &roleName, const QString &content,
                            MessageDirection direction, const QString &messageType,
-                           const QString &attachmentPath = QString());
+                           const QString &attachmentPath = QString(), qint64 timestamp = 0);
+    /*!
+     * \brief senderTimestamp 以对端时钟偏差校正聊天消息携带的发送时间，未测得偏差时返回当前时间。
+     */
+    qint64 senderTimestamp(const QString &peerId, const QJsonObject &payload) const;
     void persistSettings();
     PeerInfo findPeer(const QString &peerId) const;
     void initializeRoles();
     RoleProfile roleById(const QString &roleId) const;
     void handleRouterMessage(const PeerInfo &peer, const QJsonObject &payload);
     void handleFileMessage(const PeerInfo &peer, const QJsonObject &payload);
+    void handleTransferStarted(const FileTransferStatus &status);
+    void handleTransferFinished(const FileTransferStatus &status, bool success, const QString &errorString);
+    /*!
+     * \brief startFileTransfer 向联系人发送文件；transferId 非空时作为传输 ID，便于对端与请求对应。
+     * \return 文件不可读时返回 false
+     */
+    bool startFileTransfer(const PeerInfo &peer, const QString &filePath, const QString &transferId);
+    void announceShareDownload(const QString &peerId, const QString &fileName);
+    void sendLegacyFile(const PeerInfo &peer, const QString &filePath);
     void handleShareCatalog(const PeerInfo &peer, const QJsonObject &payload);
     void sendShareCatalogToPeer(const PeerInfo &peer);
     void handleShareRequest(const PeerInfo &peer, const QJsonObject &payload);
     void handleShareDownload(const PeerInfo &peer, const QJsonObject &payload);
+    /*!
+     * \brief callPeer 登记并发出一个 RPC 请求，应答或失败按请求 ID 找回发起时的上下文。
+     */
+    void callPeer(const PeerInfo &peer, const QString &method, const QJsonObject &params = QJsonObject());
+    void handleRpcRequest(const PeerInfo &peer, const QString &rpcId, const QString &method, const QJsonObject &params);
+    void handleRpcReply(const QString &peerId, quint64 requestId, const QJsonObject &result);
+    void handleRpcFailure(const QString &peerId, quint64 requestId, const QString &error);
+    QJsonArray localShareArray();
+    QList<SharedFileInfo> parseShareArray(const QJsonArray &array) const;
     ProfileDetails parseProfileObject(const QJsonObject &object, const QString &nameFallback,
                                       const QString &signatureFallback) const;
     QJsonObject profileToJson(const ProfileDetails &details) const;
     PeerDirectory m_peerDirectory;
     DiscoveryService m_discovery;
-    MessageRouter m_router;
+    QThread m_networkThread;
+    MessageRouter *m_router = nullptr;
+    FileTransferManager *m_transfers = nullptr;
+    RpcChannel *m_rpc = nullptr;
     QString m_localId;
     QString m_displayName;
     quint16 m_listenPort = 45600;
@@ -108,6 +193,23 @@ private:
     QVector<RoleProfile> m_roles;
     ShareManager m_shareManager;
     StorageManager m_storage;
+    QSet<QString> m_peersWithPendingUploads;
+    // 发件箱中有待确认消息的联系人 -> 下一次重发到期的时刻（毫秒级时间戳），心跳只检查内存中的到期时刻。
+    QHash<QString, qint64> m_outboxDueMs;
+    QTimer m_outboxTimer;
+    // 各联系人时钟相对本机的偏差（毫秒），用于校正收到消息的时间顺序。
+    QHash<QString, qint64> m_peerClockOffsets;
+    // 已获取的联系人资料及获取时对方的资料摘要，摘要未变时直接复用。
+    QHash<QString, QPair<quint64, ProfileDetails>> m_peerProfiles;
+    // 待批量写入的联系人最近出现时间（秒级时间戳）。
+    QHash<QString, qint64> m_peerSightings;
+    QTimer m_peerSightingTimer;
+    // 在途的 RPC 请求：请求 ID -> (联系人, 方法)。
+    QHash<quint64, QPair<QString, QString>> m_pendingCalls;
+    // share.download 应答返回的传输 ID -> 联系人，等待对应的传输邀请到达。
+    QHash<QString, QString> m_shareDownloads;
+    // 已开始但尚未与下载请求对应的接收：传输 ID -> (联系人, 文件名)，传输结束时移除。
+    QHash<QString, QPair<QString, QString>> m_unclaimedIncoming;
     bool m_storageReady = false;
     bool m_hasStoredRole = false;
 };
@@ -1,12 +1,85 @@
 #include "DiscoveryService.h"
 
+#include <QCryptographicHash>
 #include <QDateTime>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkInterface>
+#include <QRandomGenerator>
+#include <QtEndian>
+
+#include <algorithm>
+
+namespace {
+// 心跳间隔下限，也是未携带 interval 字段的旧版客户端的心跳间隔。
+constexpr qint64 HeartbeatIntervalMs = 15'000;
+constexpr qint64 MaxHeartbeatIntervalMs = 10 * 60'000;
+// 全网段所有客户端合计的心跳报文预算（每秒），人数超过预算乘以下限间隔后按人数线性拉长间隔（RTCP 方式）。
+constexpr qint64 PacketBudgetPerSecond = 20;
+// 启动时的 hello 至少在该窗口内随机延后；预计人数较多时按报文预算拉长窗口，避免整层楼同时开机时集中广播。
+constexpr int StartupSpreadMs = 3'000;
+// 资料查询与旧版 hello 回复等额外报文：按人数分摊报文预算，但每台主机至少保留的速率与可累积的突发量。
+constexpr double MinExtraPacketsPerSecond = 1.0;
+constexpr double MaxExtraBurst = 8.0;
+// 两次 hello 的最小间隔，期间重复的上线通告合并为一次。
+constexpr qint64 MinAnnounceGapMs = 1'000;
+// 对同一联系人的资料查询与对同一地址的资料应答的最小间隔，防止丢包重试演变成风暴。
+constexpr qint64 QueryGapMs = 5'000;
+constexpr int MaxThrottleEntries = 4096;
+
+/*
+ * 二进制发现报文，固定 32 字节头（大端）：
+ *   0  magic u32 "NWTD"    4  version u8    5  type u8    6  flags u16
+ *   8  peerHash u64        16 profileDigest u64
+ *   24 listenPort u16      26 intervalSecs u16    28 reserved u32
+ * flags 含 ViaBroadcast 表示发送方只以广播发送心跳，组播的客户端据此同时广播自己的心跳。
+ * flags 含 HasProfile 时其后依次为 id、displayName、capabilities、hostId、localEndpoint，
+ * 各以 u16 长度前缀的 UTF-8 编码。心跳只有报文头，资料摘要变化时接收方再单播查询完整资料。
+ */
+constexpr quint32 PacketMagic = 0x4E575444;
+constexpr quint8 PacketVersion = 1;
+constexpr int PacketHeaderSize = 32;
+constexpr quint16 HasProfile = 0x0001;
+constexpr quint16 ViaBroadcast = 0x0002;
+constexpr int MaxDatagramSize = 8 * 1024;
+
+quint64 hashOf(const QByteArray &data) {
+    return qFromBigEndian<quint64>(QCryptographicHash::hash(data, QCryptographicHash::Sha256).constData());
+}
+
+void appendString(QByteArray *out, const QString &value) {
+    const QByteArray bytes = value.toUtf8().left(1024);
+    char length[2];
+    qToBigEndian<quint16>(static_cast<quint16>(bytes.size()), length);
+    out->append(length, 2);
+    out->append(bytes);
+}
 
-DiscoveryService::DiscoveryService(QObject *parent) : QObject(parent) {
+bool readString(const char *data, int size, int *cursor, QString *value) {
+    if (*cursor + 2 > size) {
+        return false;
+    }
+    const int length = qFromBigEndian<quint16>(data + *cursor);
+    *cursor += 2;
+    if (*cursor + length > size) {
+        return false;
+    }
+    *value = QString::fromUtf8(data + *cursor, length);
+    *cursor += length;
+    return true;
+}
+constexpr int WheelTickMs = 1'000;
+// 槽数取 2 的幂且覆盖离线阈值，绝大多数联系人一圈之内即可到期，超出一圈的到期时间会被重新挂载。
+constexpr int WheelSlots = 128;
+} // namespace
+
+DiscoveryService::DiscoveryService(QObject *parent) : QObject(parent), m_wheel(WheelSlots) {
+    m_datagram.resize(MaxDatagramSize);
+    m_heartbeatTimer.setSingleShot(true);
     connect(&m_heartbeatTimer, &QTimer::timeout, this, &DiscoveryService::sendHeartbeat);
+    m_wheelTimer.setInterval(WheelTickMs);
+    connect(&m_wheelTimer, &QTimer::timeout, this, &DiscoveryService::advanceWheel);
+    m_clock.start();
 }
 
 void DiscoveryService::start(quint16 broadcastPort) {
@@ -22,16 +95,60 @@ void DiscoveryService::start(quint16 broadcastPort) {
     }
 
     connect(&m_socket, &QUdpSocket::readyRead, this, &DiscoveryService::readPendingDatagrams);
-    m_heartbeatTimer.start(15'000);
-    announceOnline();
+    joinMulticast();
+    m_wheelTimer.start();
+    m_helloPending = true;
+    m_extraTokens = MaxExtraBurst;
+    m_extraRefilledMs = m_clock.elapsed();
+    // RTCP 方式：全网段同时开机时合计的 hello（含旧版副本）速率不超过报文预算。
+    const qint64 packetsPerHello = needsLegacyHello() ? 2 : 1;
+    const qint64 spread = qBound<qint64>(
+        StartupSpreadMs, expectedMembers() * packetsPerHello * 1000 / PacketBudgetPerSecond, MaxHeartbeatIntervalMs);
+    m_heartbeatTimer.start(QRandomGenerator::global()->bounded(static_cast<int>(spread)));
+}
+
+void DiscoveryService::setExpectedPopulation(int peers) {
+    m_expectedPeers = qMax(0, peers);
+}
+
+qint64 DiscoveryService::expectedMembers() const {
+    // 本机也计入；尚未听到多数联系人时以已知联系人数作为人数的先验估计。
+    return qMax<qint64>(m_liveness.size(), m_expectedPeers) + 1;
+}
+
+bool DiscoveryService::takeExtraPacket() {
+    // 令牌桶：全网段所有客户端的额外报文合计不超过报文预算，人数很多时每台主机仍保留最低速率。
+    const qint64 now = m_clock.elapsed();
+    const double rate = qMax(MinExtraPacketsPerSecond, static_cast<double>(PacketBudgetPerSecond) / expectedMembers());
+    m_extraTokens = qMin(MaxExtraBurst, m_extraTokens + (now - m_extraRefilledMs) * rate / 1000.0);
+    m_extraRefilledMs = now;
+    if (m_extraTokens < 1.0) {
+        return false;
+    }
+    m_extraTokens -= 1.0;
+    return true;
 }
 
 void DiscoveryService::setLocalIdentity(const QString &peerId, const QString &name, quint16 listenPort) {
     m_localId = peerId;
+    m_localHash = peerId.isEmpty() ? 0 : hashOf(peerId.toUtf8());
     m_displayName = name;
     m_listenPort = listenPort;
 }
 
+void DiscoveryService::setLocalCapabilities(const QString &capabilities) {
+    m_capabilities = capabilities;
+}
+
+void DiscoveryService::setLocalEndpoint(const QString &hostId, const QString &endpoint) {
+    m_hostId = hostId;
+    m_localEndpoint = endpoint;
+}
+
+void DiscoveryService::setProfileVersion(const QByteArray &version) {
+    m_profileVersion = version;
+}
+
 void DiscoveryService::setSubnets(const QList<QPair<QHostAddress, int>> &subnets) {
     m_subnets = subnets;
 }
@@ -40,6 +157,83 @@ void DiscoveryService::setBlockedSubnets(const QList<QPair<QHostAddress, int>> &
     m_blockedSubnets = subnets;
 }
 
+void DiscoveryService::setMulticast(bool enabled, const QHostAddress &group, int ttl, const QString &interfaceName) {
+    // 先按旧组播地址退出，再换成新配置。
+    leaveMulticast();
+    m_multicastEnabled = enabled;
+    m_multicastGroup = group;
+    m_multicastTtl = qBound(1, ttl, 255);
+    m_multicastInterface = interfaceName;
+    if (m_socket.state() == QAbstractSocket::BoundState) {
+        joinMulticast();
+    }
+}
+
+void DiscoveryService::joinMulticast() {
+    leaveMulticast();
+    // 未启用组播时也加入组播组，只用于接收同网段组播客户端的心跳，失败时不提示。
+    if (!m_multicastGroup.isMulticast() || m_multicastGroup.protocol() != QAbstractSocket::IPv4Protocol) {
+        if (m_multicastEnabled) {
+            emit discoveryWarning(tr("组播地址 %1 无效，已改用广播发现").arg(m_multicastGroup.toString()));
+        }
+        return;
+    }
+    m_socket.setSocketOption(QAbstractSocket::MulticastTtlOption, m_multicastTtl);
+    // 同机的多个实例也需要收到组播，本机回声由报文头中的 peerHash 过滤。
+    m_socket.setSocketOption(QAbstractSocket::MulticastLoopbackOption, 1);
+    const auto interfaces = QNetworkInterface::allInterfaces();
+    for (const QNetworkInterface &iface : interfaces) {
+        const auto flags = iface.flags();
+        if (!(flags & QNetworkInterface::IsUp) || !(flags & QNetworkInterface::IsRunning) ||
+            !(flags & QNetworkInterface::CanMulticast) || (flags & QNetworkInterface::IsLoopBack)) {
+            continue;
+        }
+        if (!m_multicastInterface.isEmpty() && iface.name() != m_multicastInterface) {
+            continue;
+        }
+        const auto entries = iface.addressEntries();
+        const bool hasIPv4 = std::any_of(entries.cbegin(), entries.cend(), [](const QNetworkAddressEntry &entry) {
+            return entry.ip().protocol() == QAbstractSocket::IPv4Protocol;
+        });
+        if (hasIPv4 && m_socket.joinMulticastGroup(m_multicastGroup, iface)) {
+            m_multicastInterfaces.append(iface);
+        }
+    }
+    if (m_multicastEnabled && m_multicastInterfaces.isEmpty()) {
+        emit discoveryWarning(tr("无法在任何网卡上加入组播组 %1，已改用广播发现").arg(m_multicastGroup.toString()));
+    }
+}
+
+bool DiscoveryService::sendsMulticast() const {
+    return m_multicastEnabled && !m_multicastInterfaces.isEmpty();
+}
+
+void DiscoveryService::leaveMulticast() {
+    for (const QNetworkInterface &iface : std::as_const(m_multicastInterfaces)) {
+        m_socket.leaveMulticastGroup(m_multicastGroup, iface);
+    }
+    m_multicastInterfaces.clear();
+}
+
+void DiscoveryService::writeToAll(const QByteArray &payload, bool alsoBroadcast) {
+    const bool multicast = sendsMulticast();
+    // 只用广播的联系人未必加入了组播组，它们在线期间心跳也要广播一份。
+    if (!multicast || alsoBroadcast || !m_broadcastPeers.isEmpty()) {
+        const auto targets = broadcastTargets();
+        for (const auto &target : targets) {
+            m_socket.writeDatagram(payload, target, m_broadcastPort);
+        }
+    }
+    if (!multicast) {
+        return;
+    }
+    // 每块网卡各发一份，组播报文只到达加入了该组的主机。
+    for (const QNetworkInterface &iface : std::as_const(m_multicastInterfaces)) {
+        m_socket.setMulticastInterface(iface);
+        m_socket.writeDatagram(payload, m_multicastGroup, m_broadcastPort);
+    }
+}
+
 void DiscoveryService::probeSubnet(const QHostAddress &network, int prefixLength) {
     if (isBlockedRange(network, prefixLength)) {
         return;
@@ -50,43 +244,102 @@ void DiscoveryService::probeSubnet(const QHostAddress &network, int prefixLength
         return;
     }
 
-    const QByteArray payload = buildPacket(QStringLiteral("probe"));
+    const QByteArray payload = buildPacket(PacketType::Probe);
     if (!payload.isEmpty()) {
         m_socket.writeDatagram(payload, broadcast, m_broadcastPort);
     }
 }
 
 void DiscoveryService::announceOnline() {
-    sendPacket("hello");
+    if (m_helloPending) {
+        return;
+    }
+    const qint64 since = m_clock.elapsed() - m_lastAnnounceMs;
+    if (m_lastAnnounceMs > 0 && since < MinAnnounceGapMs) {
+        // 刚通告过，合并到稍后的一次 hello 中。
+        m_helloPending = true;
+        m_heartbeatTimer.start(static_cast<int>(MinAnnounceGapMs - since));
+        return;
+    }
+    sendPacket(PacketType::Hello);
+    scheduleHeartbeat();
 }
 
 void DiscoveryService::stop() {
+    // 主动告知联系人下线，对方无需等到心跳超时。
+    sendPacket(PacketType::Bye);
     if (m_heartbeatTimer.isActive()) {
         m_heartbeatTimer.stop();
     }
+    m_wheelTimer.stop();
+    leaveMulticast();
+    m_helloPending = false;
+    m_lastAnnounceMs = 0;
+    m_liveness.clear();
+    m_profiles.clear();
+    m_binaryPeers.clear();
+    m_broadcastPeers.clear();
+    m_legacyPeers.clear();
+    m_queriedAt.clear();
+    m_answeredAt.clear();
+    for (QVector<QString> &slot : m_wheel) {
+        slot.clear();
+    }
     disconnect(&m_socket, nullptr, this, nullptr);
     if (m_socket.state() != QAbstractSocket::UnconnectedState) {
         m_socket.close();
     }
 }
 
+PeerPresence DiscoveryService::presenceOf(const QString &peerId) const {
+    const auto it = m_liveness.constFind(peerId);
+    return it == m_liveness.constEnd() ? PeerPresence::Offline : it->presence;
+}
+
 void DiscoveryService::readPendingDatagrams() {
     while (m_socket.hasPendingDatagrams()) {
-        QByteArray payload;
-        payload.resize(int(m_socket.pendingDatagramSize()));
         QHostAddress sender;
-        quint16 senderPort = 0;
-        m_socket.readDatagram(payload.data(), payload.size(), &sender, &senderPort);
-        Q_UNUSED(senderPort)
-        processPacket(payload, sender);
+        // 复用同一块接收缓冲，报文头校验不通过的数据报不产生任何分配。
+        const qint64 size = m_socket.readDatagram(m_datagram.data(), m_datagram.size(), &sender);
+        if (size <= 0) {
+            continue;
+        }
+        processDatagram(m_datagram.constData(), static_cast<int>(size), sender);
     }
 }
 
 void DiscoveryService::sendHeartbeat() {
-    sendPacket("heartbeat");
+    if (m_helloPending) {
+        m_helloPending = false;
+        sendPacket(PacketType::Hello);
+        scheduleHeartbeat();
+        return;
+    }
+    // 定时器重估：到期时沿用本轮的随机系数、按当前人数重新计算间隔，人数增加或期间已发过 hello 时顺延，
+    // 不发送冗余心跳。
+    const qint64 due = m_lastAnnounceMs + static_cast<qint64>(heartbeatInterval() * m_jitter);
+    const qint64 now = m_clock.elapsed();
+    if (due > now) {
+        m_heartbeatTimer.start(static_cast<int>(due - now));
+        return;
+    }
+    sendPacket(PacketType::Heartbeat);
+    scheduleHeartbeat();
 }
 
-void DiscoveryService::sendPacket(const QString &type) {
+qint64 DiscoveryService::heartbeatInterval() const {
+    // 本机也计入人数；所有客户端观察到的人数相近，合计报文速率因此约束在预算以内。
+    const qint64 members = m_liveness.size() + 1;
+    return qBound(HeartbeatIntervalMs, members * 1000 / PacketBudgetPerSecond, MaxHeartbeatIntervalMs);
+}
+
+void DiscoveryService::scheduleHeartbeat() {
+    // 在 [0.5, 1.5] 倍间隔内均匀随机，打散同时上线的客户端的相位。
+    m_jitter = 0.5 + QRandomGenerator::global()->generateDouble();
+    m_heartbeatTimer.start(static_cast<int>(heartbeatInterval() * m_jitter));
+}
+
+void DiscoveryService::sendPacket(PacketType type) {
     if (m_socket.state() != QAbstractSocket::BoundState || m_localId.isEmpty()) {
         return;
     }
@@ -95,29 +348,190 @@ void DiscoveryService::sendPacket(const QString &type) {
     if (payload.isEmpty()) {
         return;
     }
-
-    const auto targets = broadcastTargets();
-    for (const auto &target : targets) {
-        m_socket.writeDatagram(payload, target, m_broadcastPort);
+    // 上线通告与下线通知同时广播，仍使用广播发现的客户端也能及时得知；旧版 JSON 报文只走广播。
+    const bool announce = type == PacketType::Hello || type == PacketType::Bye;
+    writeToAll(payload, announce);
+    if (type == PacketType::Hello && needsLegacyHello()) {
+        const QByteArray legacy = buildLegacyPacket();
+        const auto targets = broadcastTargets();
+        for (const auto &target : targets) {
+            m_socket.writeDatagram(legacy, target, m_broadcastPort);
+        }
     }
+    m_lastAnnounceMs = m_clock.elapsed();
+}
+
+quint64 DiscoveryService::profileDigest() const {
+    QByteArray material;
+    appendString(&material, m_displayName);
+    appendString(&material, m_capabilities);
+    appendString(&material, m_hostId);
+    appendString(&material, m_localEndpoint);
+    material.append(QByteArray::number(m_listenPort));
+    material.append(m_profileVersion);
+    return hashOf(material);
 }
 
-QByteArray DiscoveryService::buildPacket(const QString &type) const {
+QByteArray DiscoveryService::buildPacket(PacketType type) const {
     if (m_localId.isEmpty()) {
         return {};
     }
+    const bool withProfile = type == PacketType::Hello || type == PacketType::Probe;
+
+    QByteArray packet(PacketHeaderSize, Qt::Uninitialized);
+    char *header = packet.data();
+    qToBigEndian<quint32>(PacketMagic, header);
+    header[4] = static_cast<char>(PacketVersion);
+    header[5] = static_cast<char>(type);
+    quint16 flags = withProfile ? HasProfile : 0;
+    if (!sendsMulticast()) {
+        flags |= ViaBroadcast;
+    }
+    qToBigEndian<quint16>(flags, header + 6);
+    qToBigEndian<quint64>(m_localHash, header + 8);
+    qToBigEndian<quint64>(profileDigest(), header + 16);
+    qToBigEndian<quint16>(m_listenPort, header + 24);
+    qToBigEndian<quint16>(static_cast<quint16>(heartbeatInterval() / 1000), header + 26);
+    qToBigEndian<quint32>(0, header + 28);
+    if (withProfile) {
+        appendString(&packet, m_localId);
+        appendString(&packet, m_displayName);
+        appendString(&packet, m_capabilities);
+        appendString(&packet, m_hostId);
+        appendString(&packet, m_localEndpoint);
+    }
+    return packet;
+}
 
+QByteArray DiscoveryService::buildLegacyPacket() const {
     QJsonObject obj{
-        {"type", type},
+        {"type", QStringLiteral("hello")},
         {"id", m_localId},
         {"displayName", m_displayName},
         {"listenPort", static_cast<int>(m_listenPort)},
+        {"capabilities", m_capabilities},
         {"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)}
     };
     return QJsonDocument(obj).toJson(QJsonDocument::Compact);
 }
 
-void DiscoveryService::processPacket(const QByteArray &payload, const QHostAddress &sender) {
+bool DiscoveryService::needsLegacyHello() const {
+    // 尚未发现任何新版客户端时无从判断网段内是否有旧版客户端，照常附带；之后只为仍在线的旧版客户端保留。
+    return m_binaryPeers.isEmpty() || !m_legacyPeers.isEmpty();
+}
+
+void DiscoveryService::processDatagram(const char *data, int size, const QHostAddress &sender) {
+    if (size > 0 && data[0] == '{') {
+        processLegacyPacket(QByteArray(data, size), sender);
+        return;
+    }
+    // 只凭报文头拒绝外来协议、不支持的版本与本机自己的回声。
+    if (size < PacketHeaderSize || qFromBigEndian<quint32>(data) != PacketMagic ||
+        static_cast<quint8>(data[4]) != PacketVersion) {
+        return;
+    }
+    const quint64 peerHash = qFromBigEndian<quint64>(data + 8);
+    if (peerHash == m_localHash || isBlockedAddress(sender)) {
+        return;
+    }
+    const auto type = static_cast<PacketType>(static_cast<quint8>(data[5]));
+    const quint16 flags = qFromBigEndian<quint16>(data + 6);
+    const quint64 digest = qFromBigEndian<quint64>(data + 16);
+    const quint16 listenPort = qFromBigEndian<quint16>(data + 24);
+    const qint64 interval = qFromBigEndian<quint16>(data + 26) * 1000;
+
+    if (type == PacketType::Query) {
+        answerQuery(sender);
+        return;
+    }
+
+    auto profile = m_profiles.find(peerHash);
+    if (flags & HasProfile) {
+        PeerInfo info;
+        int cursor = PacketHeaderSize;
+        if (!readString(data, size, &cursor, &info.id) || !readString(data, size, &cursor, &info.displayName) ||
+            !readString(data, size, &cursor, &info.capabilities) || !readString(data, size, &cursor, &info.hostId) ||
+            !readString(data, size, &cursor, &info.localEndpoint)) {
+            return;
+        }
+        // 资料按报文头的 peerHash 缓存，哈希与 ID 不符的报文（损坏或伪造）会把他人的心跳绑定到错误的联系人上。
+        if (info.id.isEmpty() || info.id == m_localId || hashOf(info.id.toUtf8()) != peerHash) {
+            return;
+        }
+        info.profileDigest = digest;
+        m_binaryPeers.insert(info.id);
+        m_legacyPeers.remove(info.id);
+        profile = m_profiles.insert(peerHash, info);
+    }
+    if (profile == m_profiles.end()) {
+        // 尚未掌握其资料的联系人：单播查询一次完整资料，心跳本身不处理。
+        queryProfile(peerHash, sender);
+        return;
+    }
+    const QString peerId = profile->id;
+    if (type == PacketType::Bye) {
+        markOffline(peerId);
+        return;
+    }
+    if (flags & ViaBroadcast) {
+        m_broadcastPeers.insert(peerId);
+    } else {
+        m_broadcastPeers.remove(peerId);
+    }
+    if (profile->profileDigest != digest) {
+        // 资料已变化但报文未携带：先按旧资料维持存活，同时查询新资料。
+        queryProfile(peerHash, sender);
+    }
+
+    markAlive(peerId, interval > 0 ? qBound(HeartbeatIntervalMs, interval, MaxHeartbeatIntervalMs)
+                                   : HeartbeatIntervalMs);
+    PeerInfo info = profile.value();
+    info.address = sender;
+    info.listenPort = listenPort;
+    info.lastSeen = QDateTime::currentDateTimeUtc();
+    info.presence = PeerPresence::Online;
+    emit peerDiscovered(info);
+}
+
+void DiscoveryService::queryProfile(quint64 peerHash, const QHostAddress &sender) {
+    const qint64 now = m_clock.elapsed();
+    const auto last = m_queriedAt.constFind(peerHash);
+    if (last != m_queriedAt.constEnd() && now - last.value() < QueryGapMs) {
+        return;
+    }
+    // 超出预算时本次不查询，也不记录时间，下一次收到该联系人的心跳时再试。
+    if (!takeExtraPacket()) {
+        return;
+    }
+    if (m_queriedAt.size() >= MaxThrottleEntries) {
+        m_queriedAt.clear();
+    }
+    m_queriedAt.insert(peerHash, now);
+    const QByteArray packet = buildPacket(PacketType::Query);
+    if (!packet.isEmpty()) {
+        m_socket.writeDatagram(packet, sender, m_broadcastPort);
+    }
+}
+
+void DiscoveryService::answerQuery(const QHostAddress &sender) {
+    const qint64 now = m_clock.elapsed();
+    const QString key = sender.toString();
+    const auto last = m_answeredAt.constFind(key);
+    if (last != m_answeredAt.constEnd() && now - last.value() < QueryGapMs) {
+        return;
+    }
+    if (m_answeredAt.size() >= MaxThrottleEntries) {
+        m_answeredAt.clear();
+    }
+    m_answeredAt.insert(key, now);
+    // 资料应答以单播 hello 发出，只有查询方收到。
+    const QByteArray packet = buildPacket(PacketType::Hello);
+    if (!packet.isEmpty()) {
+        m_socket.writeDatagram(packet, sender, m_broadcastPort);
+    }
+}
+
+void DiscoveryService::processLegacyPacket(const QByteArray &payload, const QHostAddress &sender) {
     const QJsonDocument doc = QJsonDocument::fromJson(payload);
     if (!doc.isObject()) {
         return;
@@ -128,9 +542,18 @@ void DiscoveryService::processPacket(const QByteArray &payload, const QHostAddre
 
     const QJsonObject obj = doc.object();
     const QString senderId = obj.value(QStringLiteral("id")).toString();
-    if (senderId.isEmpty() || senderId == m_localId) {
+    // 新版客户端附带的旧版报文缺少主机标识与资料摘要，不能覆盖二进制协议维护的资料与心跳间隔。
+    if (senderId.isEmpty() || senderId == m_localId || m_binaryPeers.contains(senderId)) {
         return;
     }
+    if (!m_legacyPeers.contains(senderId)) {
+        // 首次出现的旧版客户端：单播回一份旧版 hello，不必等到下一次上线通告；超出预算时留给下一次通告。
+        m_legacyPeers.insert(senderId);
+        if (takeExtraPacket()) {
+            m_socket.writeDatagram(buildLegacyPacket(), sender, m_broadcastPort);
+        }
+    }
+    markAlive(senderId, HeartbeatIntervalMs);
 
     PeerInfo info;
     info.id = senderId;
@@ -139,10 +562,101 @@ void DiscoveryService::processPacket(const QByteArray &payload, const QHostAddre
     info.listenPort = static_cast<quint16>(obj.value(QStringLiteral("listenPort")).toInt());
     info.lastSeen = QDateTime::currentDateTimeUtc();
     info.capabilities = obj.value(QStringLiteral("capabilities")).toString();
+    info.presence = PeerPresence::Online;
 
     emit peerDiscovered(info);
 }
 
+qint64 DiscoveryService::awayAfter(qint64 intervalMs) {
+    // 随机化后的最大间隔为 1.5 倍，连续漏掉约两次心跳（另留 5 秒余量）才视为离开。
+    return 2 * intervalMs + 5'000;
+}
+
+qint64 DiscoveryService::offlineAfter(qint64 intervalMs) {
+    return 5 * intervalMs;
+}
+
+void DiscoveryService::markAlive(const QString &peerId, qint64 intervalMs) {
+    const qint64 now = m_clock.elapsed();
+    auto it = m_liveness.find(peerId);
+    if (it == m_liveness.end()) {
+        it = m_liveness.insert(peerId, Liveness());
+        it->lastHeardMs = now;
+        it->intervalMs = intervalMs;
+        schedule(peerId, now + awayAfter(intervalMs));
+        emit peerPresenceChanged(peerId, PeerPresence::Offline, PeerPresence::Online);
+        return;
+    }
+    // 心跳只刷新时间戳，不移动时间轮中的位置，到期时再按最新时间戳重新挂载。
+    it->lastHeardMs = now;
+    it->intervalMs = intervalMs;
+    if (it->presence != PeerPresence::Online) {
+        const PeerPresence previous = it->presence;
+        it->presence = PeerPresence::Online;
+        emit peerPresenceChanged(peerId, previous, PeerPresence::Online);
+    }
+}
+
+void DiscoveryService::markOffline(const QString &peerId) {
+    const auto it = m_liveness.constFind(peerId);
+    if (it == m_liveness.constEnd()) {
+        return;
+    }
+    // 时间轮中残留的槽位记录在到期时因找不到联系人而被跳过。
+    const PeerPresence previous = it->presence;
+    m_liveness.erase(it);
+    // 下线的联系人不再保留缓存资料，再次上线时重新查询。
+    m_profiles.remove(hashOf(peerId.toUtf8()));
+    m_binaryPeers.remove(peerId);
+    m_broadcastPeers.remove(peerId);
+    m_legacyPeers.remove(peerId);
+    emit peerPresenceChanged(peerId, previous, PeerPresence::Offline);
+}
+
+void DiscoveryService::schedule(const QString &peerId, qint64 deadlineMs) {
+    auto it = m_liveness.find(peerId);
+    if (it == m_liveness.end()) {
+        return;
+    }
+    const qint64 tick = (deadlineMs + WheelTickMs - 1) / WheelTickMs;
+    it->dueTick = qBound(m_tick + 1, tick, m_tick + WheelSlots - 1);
+    m_wheel[static_cast<int>(it->dueTick & (WheelSlots - 1))].append(peerId);
+}
+
+void DiscoveryService::advanceWheel() {
+    const qint64 target = m_clock.elapsed() / WheelTickMs;
+    while (m_tick < target) {
+        ++m_tick;
+        QVector<QString> due;
+        due.swap(m_wheel[static_cast<int>(m_tick & (WheelSlots - 1))]);
+        for (const QString &peerId : std::as_const(due)) {
+            expire(peerId);
+        }
+    }
+}
+
+void DiscoveryService::expire(const QString &peerId) {
+    auto it = m_liveness.find(peerId);
+    // 联系人已下线或已改挂到其他 tick 时，该槽位记录已过期。
+    if (it == m_liveness.end() || it->dueTick != m_tick) {
+        return;
+    }
+    const qint64 silence = m_clock.elapsed() - it->lastHeardMs;
+    if (silence >= offlineAfter(it->intervalMs)) {
+        markOffline(peerId);
+        return;
+    }
+    const bool away = silence >= awayAfter(it->intervalMs) && it->presence == PeerPresence::Online;
+    if (away) {
+        it->presence = PeerPresence::Away;
+    }
+    schedule(peerId, it->lastHeardMs + (it->presence == PeerPresence::Online ? awayAfter(it->intervalMs)
+                                                                             : offlineAfter(it->intervalMs)));
+    if (away) {
+        emit peerPresenceChanged(peerId, PeerPresence::Online, PeerPresence::Away);
+    }
+}
+
 QList<QHostAddress> DiscoveryService::broadcastTargets() const {
     QList<QHostAddress> targets;
 
@@ -2,11 +2,16 @@
 
 #include "PeerInfo.h"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QHostAddress>
+#include <QNetworkInterface>
 #include <QObject>
 #include <QPair>
+#include <QSet>
 #include <QTimer>
 #include <QUdpSocket>
+#include <QVector>
 
 class DiscoveryService : public QObject {
     Q_OBJECT
@@ -16,35 +21,134 @@ public:
 
     void start(quint16 broadcastPort = 45454);
     void setLocalIdentity(const QString &peerId, const QString &name, quint16 listenPort);
+    void setLocalCapabilities(const QString &capabilities);
+    /*!
+     * \brief setLocalEndpoint 广播本机标识与同机直连端点，同一主机上的联系人据此绕过 TCP 协议栈。
+     */
+    void setLocalEndpoint(const QString &hostId, const QString &endpoint);
+    /*!
+     * \brief setProfileVersion 设置个人资料（含头像）的版本标识，并入广播的资料摘要，
+     *        联系人只在摘要变化时重新获取资料。
+     */
+    void setProfileVersion(const QByteArray &version);
+    /*!
+     * \brief setExpectedPopulation 预计的联系人数（如本地保存的联系人数），在 start 之前设置，
+     *        用于拉长启动时 hello 的随机延后窗口，并在尚未听到多数联系人时分摊额外报文的预算。
+     */
+    void setExpectedPopulation(int peers);
     void setSubnets(const QList<QPair<QHostAddress, int>> &subnets);
     void setBlockedSubnets(const QList<QPair<QHostAddress, int>> &subnets);
+    /*!
+     * \brief setMulticast 配置组播发现：在所选网卡（interfaceName 为空表示全部可组播网卡）上加入 group，
+     *        心跳改发到组播组，未运行本程序的主机不再被唤醒，经组播路由的 VLAN 之间也能互相发现。
+     *        未启用或所有网卡均加入失败时退回子网广播，但仍尽量加入 group 以收到组播客户端的心跳。
+     *        运行中调用会立即重新加入组播组。
+     */
+    void setMulticast(bool enabled, const QHostAddress &group, int ttl, const QString &interfaceName = QString());
     void probeSubnet(const QHostAddress &network, int prefixLength);
     void announceOnline();
     void stop();
+    /*!
+     * \brief presenceOf 联系人当前的在线状态，从未收到过其报文时为离线。
+     */
+    PeerPresence presenceOf(const QString &peerId) const;
 
 signals:
     void peerDiscovered(const PeerInfo &info);
     void discoveryWarning(const QString &message);
+    /*!
+     * \brief peerPresenceChanged 联系人在线状态发生变化，每次状态迁移只发出一次。
+     */
+    void peerPresenceChanged(const QString &peerId, PeerPresence previous, PeerPresence current);
 
 private slots:
     void readPendingDatagrams();
     void sendHeartbeat();
+    void advanceWheel();
 
 private:
-    void sendPacket(const QString &type);
-    QByteArray buildPacket(const QString &type) const;
-    void processPacket(const QByteArray &payload, const QHostAddress &sender);
+    enum class PacketType : quint8 { Hello = 1, Heartbeat = 2, Probe = 3, Bye = 4, Query = 5 };
+
+    void sendPacket(PacketType type);
+    QByteArray buildPacket(PacketType type) const;
+    QByteArray buildLegacyPacket() const;
+    bool needsLegacyHello() const;
+    quint64 profileDigest() const;
+    void processDatagram(const char *data, int size, const QHostAddress &sender);
+    void processLegacyPacket(const QByteArray &payload, const QHostAddress &sender);
+    void queryProfile(quint64 peerHash, const QHostAddress &sender);
+    void answerQuery(const QHostAddress &sender);
     QList<QHostAddress> broadcastTargets() const;
+    void joinMulticast();
+    void leaveMulticast();
+    void writeToAll(const QByteArray &payload, bool alsoBroadcast);
+    bool sendsMulticast() const;
     static QHostAddress broadcastFor(const QHostAddress &network, int prefixLength);
     bool isBlockedAddress(const QHostAddress &address) const;
     bool isBlockedRange(const QHostAddress &network, int prefixLength) const;
+    qint64 heartbeatInterval() const;
+    qint64 expectedMembers() const;
+    bool takeExtraPacket();
+    void scheduleHeartbeat();
+    static qint64 awayAfter(qint64 intervalMs);
+    static qint64 offlineAfter(qint64 intervalMs);
+    void markAlive(const QString &peerId, qint64 intervalMs);
+    void markOffline(const QString &peerId);
+    void schedule(const QString &peerId, qint64 deadlineMs);
+    void expire(const QString &peerId);
+
+    /*!
+     * \brief 联系人的存活记录：收到报文只刷新 lastHeardMs，到期检查由时间轮在 dueTick 时进行。
+     */
+    struct Liveness {
+        qint64 lastHeardMs = 0;
+        qint64 dueTick = 0;
+        qint64 intervalMs = 0;
+        PeerPresence presence = PeerPresence::Online;
+    };
 
     QUdpSocket m_socket;
     QTimer m_heartbeatTimer;
     QString m_localId;
     QString m_displayName;
+    QString m_capabilities;
+    QString m_hostId;
+    QString m_localEndpoint;
+    QByteArray m_profileVersion;
+    quint64 m_localHash = 0;
+    QByteArray m_datagram;
+    // 按 peerHash 缓存的联系人资料，心跳只带报文头，据此还原出完整的 PeerInfo。
+    QHash<quint64, PeerInfo> m_profiles;
+    // 以二进制协议通告过的联系人，其旧版 JSON 报文只是兼容副本，直接忽略。
+    QSet<QString> m_binaryPeers;
+    // 只以广播发送心跳的联系人，存在时组播心跳同时广播一份，混用两种方式的网段仍能维持存活。
+    QSet<QString> m_broadcastPeers;
+    // 只以旧版 JSON 报文出现过的联系人，存在时本机的 hello 才附带旧版报文。
+    QSet<QString> m_legacyPeers;
+    QHash<quint64, qint64> m_queriedAt;
+    QHash<QString, qint64> m_answeredAt;
     quint16 m_listenPort = 0;
     quint16 m_broadcastPort = 45454;
     QList<QPair<QHostAddress, int>> m_subnets;
     QList<QPair<QHostAddress, int>> m_blockedSubnets;
+    bool m_multicastEnabled = false;
+    QHostAddress m_multicastGroup;
+    int m_multicastTtl = 1;
+    QString m_multicastInterface;
+    // 已成功加入组播组的网卡；未启用组播时也加入以便接收，此时仍按广播方式发送。
+    QList<QNetworkInterface> m_multicastInterfaces;
+    // 哈希时间轮：每个槽对应一个 tick，联系人按到期 tick 挂在对应槽上，推进一格只检查该槽。
+    QTimer m_wheelTimer;
+    QElapsedTimer m_clock;
+    QVector<QVector<QString>> m_wheel;
+    qint64 m_tick = 0;
+    // 最近一次发出 hello/心跳的时刻，用于定时器重估与合并重复通告。
+    qint64 m_lastAnnounceMs = 0;
+    bool m_helloPending = false;
+    int m_expectedPeers = 0;
+    // 额外报文（资料查询、旧版 hello 回复）的令牌桶。
+    double m_extraTokens = 0.0;
+    qint64 m_extraRefilledMs = 0;
+    double m_jitter = 1.0;
+    QHash<QString, Liveness> m_liveness;
 };
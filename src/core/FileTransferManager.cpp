@@ -0,0 +1,751 @@
+#include "FileTransferManager.h"
+
+#include "ShareManager.h"
+
+#include <QFileInfo>
+#include <QPointer>
+#include <QThreadPool>
+#include <QUuid>
+
+#include <iterator>
+
+namespace {
+constexpr qint64 ChunkSize = 64 * 1024;
+// 零拷贝路径每个区段的大小：数据不经用户态，区段可以比普通数据块大得多。
+constexpr qint64 RegionSize = 1024 * 1024;
+constexpr quint64 WindowBytes = 4 * 1024 * 1024;
+constexpr quint64 AckInterval = 512 * 1024;
+constexpr quint64 CheckpointInterval = 8 * 1024 * 1024;
+constexpr qint64 HashBlockSize = 1024 * 1024;
+// 达到该大小的文件才考虑多连接条带发送，小文件单连接即可跑满链路。
+constexpr quint64 StripeThreshold = 64 * 1024 * 1024;
+// 条带单元：连续这么多字节写在同一条连接上后再轮换，避免接收端产生大量零碎的乱序区段。
+constexpr qint64 StripeUnit = 1024 * 1024;
+// 每确认这么多数据采样一次吞吐，决定是否调整条带数。
+constexpr quint64 RateSampleBytes = 32 * 1024 * 1024;
+
+QString partPathFor(const QString &localPath) {
+    return localPath + QStringLiteral(".part");
+}
+} // namespace
+
+FileTransferManager::FileTransferManager(MessageRouter *router, QObject *parent)
+    : QObject(parent), m_router(router) {
+    if (m_router) {
+        connect(m_router, &MessageRouter::fileChunkReceived, this, &FileTransferManager::handleChunk);
+        connect(m_router, &MessageRouter::sessionClosed, this, &FileTransferManager::handleSessionClosed);
+        connect(m_router, &MessageRouter::stripeClosed, this, &FileTransferManager::handleStripeClosed);
+        connect(m_router, &MessageRouter::peerBackpressure, this, &FileTransferManager::handlePeerBackpressure);
+        connect(m_router, &MessageRouter::messageReceived, this, [this](const PeerInfo &peer, const QJsonObject &payload) {
+            if (isControlMessage(payload.value(QStringLiteral("type")).toString())) {
+                handleControlMessage(peer, payload);
+            }
+        });
+    }
+}
+
+void FileTransferManager::startUpload(const PeerInfo &peer, const QString &filePath, const QString &roleId,
+                                      const QString &roleName, const QString &transferId) {
+    auto transfer = QSharedPointer<OutgoingTransfer>::create();
+    FileTransferStatus &status = transfer->status;
+    status.transferId = transferId.isEmpty() ? QUuid::createUuid().toString(QUuid::WithoutBraces) : transferId;
+    status.peerId = peer.id;
+    status.fileName = QFileInfo(filePath).fileName();
+    status.localPath = filePath;
+    status.roleName = roleName;
+    status.outgoing = true;
+    transfer->peer = peer;
+    transfer->roleId = roleId;
+    transfer->file.setFileName(filePath);
+    if (!transfer->file.open(QIODevice::ReadOnly)) {
+        emit transferFinished(status, false, transfer->file.errorString());
+        return;
+    }
+    status.totalBytes = static_cast<quint64>(transfer->file.size());
+    m_outgoing.insert(status.transferId, transfer);
+    emit transferStarted(status);
+
+    // 内容哈希用于续传时识别同一文件以及接收端最终校验，在线程池中计算以免阻塞事件循环。
+    const QString transferId = status.transferId;
+    const Hasher hasher = Hasher::create(QCryptographicHash::Sha256);
+    hashFileAsync(filePath, status.totalBytes, hasher, [this, transferId, hasher](bool ok) {
+        const auto pending = m_outgoing.value(transferId);
+        if (!pending) {
+            return;
+        }
+        if (!ok) {
+            finishOutgoing(transferId, false, tr("无法计算文件校验值"));
+            return;
+        }
+        pending->contentHash = QString::fromLatin1(hasher->result().toHex());
+        emit checkpointUpdated(checkpointFor(*pending));
+        sendOffer(pending);
+    });
+}
+
+void FileTransferManager::resumeUpload(const PeerInfo &peer, const TransferCheckpoint &checkpoint) {
+    if (!checkpoint.outgoing || m_outgoing.contains(checkpoint.transferId)) {
+        return;
+    }
+
+    // 源文件被移动或修改时无法续传，直接丢弃检查点。
+    auto transfer = QSharedPointer<OutgoingTransfer>::create();
+    transfer->file.setFileName(checkpoint.localPath);
+    if (checkpoint.contentHash.isEmpty() || !transfer->file.open(QIODevice::ReadOnly) ||
+        static_cast<quint64>(transfer->file.size()) != checkpoint.totalSize) {
+        emit checkpointDiscarded(checkpoint.transferId);
+        return;
+    }
+
+    FileTransferStatus &status = transfer->status;
+    status.transferId = checkpoint.transferId;
+    status.peerId = peer.id;
+    status.fileName = checkpoint.fileName;
+    status.localPath = checkpoint.localPath;
+    status.roleName = checkpoint.roleName;
+    status.totalBytes = checkpoint.totalSize;
+    status.transferredBytes = checkpoint.committedOffset;
+    status.outgoing = true;
+    transfer->peer = peer;
+    transfer->roleId = checkpoint.roleId;
+    transfer->contentHash = checkpoint.contentHash;
+    transfer->persistedOffset = checkpoint.committedOffset;
+    m_outgoing.insert(status.transferId, transfer);
+    emit transferStarted(status);
+    sendOffer(transfer);
+}
+
+void FileTransferManager::restoreIncoming(const QVector<TransferCheckpoint> &checkpoints) {
+    for (const TransferCheckpoint &checkpoint : checkpoints) {
+        if (!checkpoint.outgoing && !checkpoint.transferId.isEmpty()) {
+            m_resumableIncoming.insert(checkpoint.transferId, checkpoint);
+        }
+    }
+}
+
+void FileTransferManager::cancelTransfer(const QString &transferId) {
+    if (const auto outgoing = m_outgoing.value(transferId)) {
+        sendCancel(outgoing->peer, transferId, tr("发送方已取消"));
+        finishOutgoing(transferId, false, tr("已取消"));
+    } else if (const auto incoming = m_incoming.value(transferId)) {
+        sendCancel(incoming->peer, transferId, tr("接收方已取消"));
+        finishIncoming(transferId, false, tr("已取消"));
+    }
+}
+
+bool FileTransferManager::isControlMessage(const QString &type) {
+    return type == QStringLiteral("file_offer") || type == QStringLiteral("file_accept") ||
+           type == QStringLiteral("file_ack") || type == QStringLiteral("file_cancel");
+}
+
+void FileTransferManager::handleControlMessage(const PeerInfo &peer, const QJsonObject &payload) {
+    const QString type = payload.value(QStringLiteral("type")).toString();
+    if (type == QStringLiteral("file_offer")) {
+        handleOffer(peer, payload);
+        return;
+    }
+
+    const QString transferId = payload.value(QStringLiteral("transferId")).toString();
+    const auto outgoing = m_outgoing.value(transferId);
+    const auto incoming = m_incoming.value(transferId);
+    // 只接受传输对端发来的控制消息。
+    if ((outgoing && outgoing->status.peerId != peer.id) || (incoming && incoming->status.peerId != peer.id)) {
+        return;
+    }
+
+    if (type == QStringLiteral("file_accept")) {
+        handleAccept(payload);
+    } else if (type == QStringLiteral("file_ack")) {
+        handleAck(payload);
+    } else if (type == QStringLiteral("file_cancel")) {
+        const QString reason = payload.value(QStringLiteral("reason")).toString(tr("对方已取消"));
+        if (outgoing) {
+            finishOutgoing(transferId, false, reason);
+        } else if (incoming) {
+            finishIncoming(transferId, false, reason);
+        }
+    }
+}
+
+void FileTransferManager::sendOffer(const QSharedPointer<OutgoingTransfer> &transfer) {
+    const FileTransferStatus &status = transfer->status;
+    const QJsonObject offer{
+        {QStringLiteral("type"), QStringLiteral("file_offer")},
+        {QStringLiteral("transferId"), status.transferId},
+        {QStringLiteral("fileName"), status.fileName},
+        {QStringLiteral("fileSize"), static_cast<double>(status.totalBytes)},
+        {QStringLiteral("contentHash"), transfer->contentHash},
+        {QStringLiteral("roleId"), transfer->roleId},
+        {QStringLiteral("roleName"), status.roleName}
+    };
+    m_router->sendTransferControl(transfer->peer, offer);
+}
+
+void FileTransferManager::handleOffer(const PeerInfo &peer, const QJsonObject &payload) {
+    const QString transferId = payload.value(QStringLiteral("transferId")).toString();
+    const QString fileName = payload.value(QStringLiteral("fileName")).toString();
+    if (transferId.isEmpty() || fileName.isEmpty()) {
+        return;
+    }
+    if (const auto active = m_incoming.value(transferId)) {
+        if (active->status.peerId != peer.id) {
+            return;
+        }
+        // 对端已察觉断线并重新发起，本端旧状态作废但保留检查点以便续传。
+        finishIncoming(transferId, false, tr("连接已断开"), true);
+    }
+
+    const QString contentHash = payload.value(QStringLiteral("contentHash")).toString();
+    const quint64 totalBytes = static_cast<quint64>(payload.value(QStringLiteral("fileSize")).toDouble());
+    const TransferCheckpoint saved = m_resumableIncoming.take(transferId);
+    bool resume = !saved.transferId.isEmpty() && saved.peerId == peer.id && !contentHash.isEmpty() &&
+                  saved.contentHash == contentHash && saved.totalSize == totalBytes &&
+                  QFile::exists(partPathFor(saved.localPath));
+
+    auto transfer = QSharedPointer<IncomingTransfer>::create();
+    FileTransferStatus &status = transfer->status;
+    status.transferId = transferId;
+    status.peerId = peer.id;
+    status.fileName = QFileInfo(fileName).fileName();
+    status.localPath = resume ? saved.localPath : ShareManager::reserveIncomingPath(fileName);
+    status.roleName = payload.value(QStringLiteral("roleName")).toString(peer.displayName);
+    status.totalBytes = totalBytes;
+    status.outgoing = false;
+    transfer->peer = peer;
+    transfer->contentHash = contentHash;
+    transfer->hasher = Hasher::create(QCryptographicHash::Sha256);
+
+    transfer->file.setFileName(partPathFor(status.localPath));
+    // 条带发送时区段乱序到达，前缀连续后需读回补算哈希，因此始终以读写方式打开。
+    if (!transfer->file.open(resume ? QIODevice::ReadWrite : QIODevice::ReadWrite | QIODevice::Truncate)) {
+        const QString error = transfer->file.errorString();
+        sendCancel(peer, transferId, error);
+        if (!saved.transferId.isEmpty()) {
+            emit checkpointDiscarded(transferId);
+        }
+        emit transferFinished(status, false, error);
+        return;
+    }
+
+    m_incoming.insert(transferId, transfer);
+    emit transferStarted(status);
+
+    if (!resume) {
+        if (!saved.transferId.isEmpty()) {
+            QFile::remove(partPathFor(saved.localPath));
+        }
+        acceptIncoming(transfer, QString());
+        return;
+    }
+
+    // 丢弃最后一个检查点之后未确认落盘的数据，再对保留的前缀计算哈希交由发送端核对。
+    const quint64 committed = qMin(saved.committedOffset, static_cast<quint64>(transfer->file.size()));
+    transfer->file.resize(static_cast<qint64>(committed));
+    status.transferredBytes = committed;
+    const Hasher hasher = transfer->hasher;
+    hashFileAsync(transfer->file.fileName(), committed, hasher, [this, transferId, hasher](bool ok) {
+        const auto pending = m_incoming.value(transferId);
+        if (!pending || pending->hasher != hasher) {
+            return;
+        }
+        if (!ok) {
+            pending->file.resize(0);
+            pending->hasher->reset();
+            pending->status.transferredBytes = 0;
+            acceptIncoming(pending, QString());
+            return;
+        }
+        // Qt 的 result() 基于内部状态的副本计算，之后仍可继续 addData 累积后续数据。
+        acceptIncoming(pending, QString::fromLatin1(pending->hasher->result().toHex()));
+    });
+}
+
+void FileTransferManager::acceptIncoming(const QSharedPointer<IncomingTransfer> &transfer,
+                                         const QString &prefixHash) {
+    FileTransferStatus &status = transfer->status;
+    // 预先分配完整文件，乱序到达的区段直接写入对应偏移。
+    if (static_cast<quint64>(transfer->file.size()) < status.totalBytes &&
+        !transfer->file.resize(static_cast<qint64>(status.totalBytes))) {
+        const QString error = transfer->file.errorString();
+        sendCancel(transfer->peer, status.transferId, error);
+        finishIncoming(status.transferId, false, error);
+        return;
+    }
+    transfer->file.seek(static_cast<qint64>(status.transferredBytes));
+    transfer->ackedOffset = status.transferredBytes;
+    transfer->committedOffset = status.transferredBytes;
+    emit checkpointUpdated(checkpointFor(*transfer));
+
+    const QJsonObject accept{
+        {QStringLiteral("type"), QStringLiteral("file_accept")},
+        {QStringLiteral("transferId"), status.transferId},
+        {QStringLiteral("offset"), static_cast<double>(status.transferredBytes)},
+        {QStringLiteral("prefixHash"), prefixHash}
+    };
+    m_router->sendTransferControl(transfer->peer, accept);
+    if (status.transferredBytes >= status.totalBytes) {
+        completeIncoming(transfer);
+    } else if (status.transferredBytes > 0) {
+        emit transferProgress(status);
+    }
+}
+
+void FileTransferManager::handleAccept(const QJsonObject &payload) {
+    const QString transferId = payload.value(QStringLiteral("transferId")).toString();
+    const auto transfer = m_outgoing.value(transferId);
+    if (!transfer || transfer->accepted) {
+        return;
+    }
+    const quint64 offset = qMin(static_cast<quint64>(payload.value(QStringLiteral("offset")).toDouble()),
+                                transfer->status.totalBytes);
+    if (offset == 0) {
+        beginSending(transfer, 0);
+        return;
+    }
+
+    // 接收端声明已有前缀时，先核对本地同一区间的哈希，不一致则从头重传。
+    const QByteArray prefixHash = payload.value(QStringLiteral("prefixHash")).toString().toLatin1();
+    const Hasher hasher = Hasher::create(QCryptographicHash::Sha256);
+    hashFileAsync(transfer->file.fileName(), offset, hasher,
+                  [this, transferId, hasher, prefixHash, offset](bool ok) {
+                      const auto pending = m_outgoing.value(transferId);
+                      if (!pending || pending->accepted) {
+                          return;
+                      }
+                      const bool matches = ok && hasher->result().toHex() == prefixHash;
+                      beginSending(pending, matches ? offset : 0);
+                  });
+}
+
+void FileTransferManager::beginSending(const QSharedPointer<OutgoingTransfer> &transfer, quint64 offset) {
+    if (!transfer->file.seek(static_cast<qint64>(offset))) {
+        const QString error = transfer->file.errorString();
+        sendCancel(transfer->peer, transfer->status.transferId, error);
+        finishOutgoing(transfer->status.transferId, false, error);
+        return;
+    }
+    transfer->accepted = true;
+    transfer->sentOffset = offset;
+    transfer->status.transferredBytes = offset;
+    transfer->striped = transfer->status.totalBytes >= StripeThreshold && m_router->canStripe(transfer->peer);
+    transfer->stripes = 1;
+    transfer->stripe = 0;
+    transfer->unitRemaining = 0;
+    transfer->rateClock.start();
+    transfer->rateBaseOffset = offset;
+    transfer->bestRate = 0.0;
+    transfer->rateSettled = !transfer->striped;
+    if (offset > 0) {
+        emit transferProgress(transfer->status);
+    }
+    pumpOutgoing(transfer);
+}
+
+void FileTransferManager::handleAck(const QJsonObject &payload) {
+    const QString transferId = payload.value(QStringLiteral("transferId")).toString();
+    const auto transfer = m_outgoing.value(transferId);
+    if (!transfer || !transfer->accepted) {
+        return;
+    }
+    const quint64 offset = qMin(static_cast<quint64>(payload.value(QStringLiteral("offset")).toDouble()),
+                                transfer->sentOffset);
+    if (offset <= transfer->status.transferredBytes && offset < transfer->status.totalBytes) {
+        return;
+    }
+    transfer->status.transferredBytes = offset;
+    if (offset >= transfer->status.totalBytes) {
+        finishOutgoing(transferId, true, QString());
+        return;
+    }
+    if (offset - transfer->persistedOffset >= CheckpointInterval) {
+        transfer->persistedOffset = offset;
+        emit checkpointUpdated(checkpointFor(*transfer));
+    }
+    emit transferProgress(transfer->status);
+    adaptStripes(transfer);
+    pumpOutgoing(transfer);
+}
+
+void FileTransferManager::pumpOutgoing(const QSharedPointer<OutgoingTransfer> &transfer) {
+    const quint64 total = transfer->status.totalBytes;
+    // 在途数据不超过窗口大小（条带发送时按条带数放大），等待接收端确认后再继续读取文件；
+    // 连接拥塞时暂停，待背压解除后继续。
+    const quint64 window = WindowBytes * static_cast<quint64>(transfer->stripes);
+    while (transfer->accepted && transfer->sentOffset < total &&
+           transfer->sentOffset - transfer->status.transferredBytes < window && nextStripe(transfer)) {
+        const quint64 unitLeft = transfer->striped ? static_cast<quint64>(transfer->unitRemaining) : total;
+        if (m_router->canSendFileRegion(transfer->peer)) {
+            const qint64 length =
+                static_cast<qint64>(qMin<quint64>(qMin<quint64>(RegionSize, total - transfer->sentOffset), unitLeft));
+            if (!sendRegion(transfer, length)) {
+                return;
+            }
+            transfer->sentOffset += static_cast<quint64>(length);
+            transfer->unitRemaining -= length;
+            continue;
+        }
+        if (transfer->file.pos() != static_cast<qint64>(transfer->sentOffset)) {
+            transfer->file.seek(static_cast<qint64>(transfer->sentOffset));
+        }
+        const qint64 wanted =
+            static_cast<qint64>(qMin<quint64>(qMin<quint64>(ChunkSize, total - transfer->sentOffset), unitLeft));
+        const QByteArray chunk = transfer->file.read(wanted);
+        if (chunk.isEmpty()) {
+            const QString error = transfer->file.errorString();
+            sendCancel(transfer->peer, transfer->status.transferId, error);
+            finishOutgoing(transfer->status.transferId, false, error);
+            return;
+        }
+        if (!m_router->sendFileChunk(transfer->peer, transfer->status.transferId, transfer->sentOffset, chunk,
+                                     transfer->stripe)) {
+            transfer->file.seek(static_cast<qint64>(transfer->sentOffset));
+            return;
+        }
+        transfer->sentOffset += static_cast<quint64>(chunk.size());
+        transfer->unitRemaining -= chunk.size();
+    }
+}
+
+bool FileTransferManager::nextStripe(const QSharedPointer<OutgoingTransfer> &transfer) {
+    if (!transfer->striped) {
+        return m_router->canSendBulk(transfer->peer);
+    }
+    if (transfer->unitRemaining > 0) {
+        // 条带单元写到一半时必须留在同一连接上，该连接拥塞就等待其背压解除。
+        return m_router->canSendBulk(transfer->peer, transfer->stripe);
+    }
+    // 新的条带单元交给下一条未拥塞的连接，尚未建立的条带连接由路由按需建立。
+    for (int i = 1; i <= transfer->stripes; ++i) {
+        const int candidate = (transfer->stripe + i) % transfer->stripes;
+        if (m_router->canSendBulk(transfer->peer, candidate)) {
+            transfer->stripe = candidate;
+            transfer->unitRemaining = StripeUnit;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileTransferManager::adaptStripes(const QSharedPointer<OutgoingTransfer> &transfer) {
+    if (!transfer->striped || transfer->rateSettled) {
+        return;
+    }
+    const quint64 acked = transfer->status.transferredBytes - transfer->rateBaseOffset;
+    const qint64 elapsed = transfer->rateClock.elapsed();
+    if (acked < RateSampleBytes || elapsed <= 0) {
+        return;
+    }
+    const double rate = static_cast<double>(acked) / static_cast<double>(elapsed);
+    transfer->rateClock.restart();
+    transfer->rateBaseOffset = transfer->status.transferredBytes;
+    // 每加一条连接吞吐至少提升 10% 才继续加；没有收益说明瓶颈已不在单条流上，退回上一档并保持。
+    if (rate > transfer->bestRate * 1.1) {
+        transfer->bestRate = rate;
+        if (transfer->stripes < MessageRouter::MaxBulkStripes) {
+            ++transfer->stripes;
+        } else {
+            transfer->rateSettled = true;
+        }
+        return;
+    }
+    if (transfer->stripes > 1 && rate < transfer->bestRate) {
+        --transfer->stripes;
+    }
+    transfer->rateSettled = true;
+}
+
+bool FileTransferManager::sendRegion(const QSharedPointer<OutgoingTransfer> &transfer, qint64 length) {
+    if (!transfer->regionFile) {
+        auto file = QSharedPointer<QFile>::create(transfer->file.fileName());
+        if (!file->open(QIODevice::ReadOnly)) {
+            const QString error = file->errorString();
+            sendCancel(transfer->peer, transfer->status.transferId, error);
+            finishOutgoing(transfer->status.transferId, false, error);
+            return false;
+        }
+        transfer->regionFile = file;
+    }
+    return m_router->sendFileRegion(transfer->peer, transfer->status.transferId, transfer->sentOffset,
+                                    transfer->regionFile, length, transfer->stripe);
+}
+
+void FileTransferManager::handlePeerBackpressure(const QString &peerId, bool congested) {
+    if (congested) {
+        return;
+    }
+    const auto transfers = m_outgoing.values();
+    for (const auto &transfer : transfers) {
+        if (transfer->status.peerId == peerId && m_outgoing.contains(transfer->status.transferId)) {
+            pumpOutgoing(transfer);
+        }
+    }
+}
+
+void FileTransferManager::handleChunk(const QString &peerId, const QString &transferId, quint64 offset,
+                                      const QByteArray &data) {
+    const auto transfer = m_incoming.value(transferId);
+    if (!transfer || transfer->status.peerId != peerId) {
+        return;
+    }
+
+    FileTransferStatus &status = transfer->status;
+    if (offset == 0 && status.transferredBytes > 0) {
+        // 发送端核对前缀失败后从头重传，丢弃本地已有前缀；已收到的乱序区段属于重传数据，予以保留。
+        transfer->hasher->reset();
+        status.transferredBytes = 0;
+        transfer->ackedOffset = 0;
+        transfer->committedOffset = 0;
+        emit checkpointUpdated(checkpointFor(*transfer));
+    }
+
+    const quint64 end = offset + static_cast<quint64>(data.size());
+    bool overlaps = false;
+    auto next = transfer->ranges.upperBound(offset);
+    if (next != transfer->ranges.begin() && std::prev(next).value() > offset) {
+        overlaps = true;
+    }
+    if (next != transfer->ranges.end() && next.key() < end) {
+        overlaps = true;
+    }
+    if (offset < status.transferredBytes || end > status.totalBytes || overlaps) {
+        sendCancel(transfer->peer, transferId, tr("数据块偏移量不一致"));
+        finishIncoming(transferId, false, tr("数据块偏移量不一致"));
+        return;
+    }
+    if ((transfer->file.pos() != static_cast<qint64>(offset) && !transfer->file.seek(static_cast<qint64>(offset))) ||
+        transfer->file.write(data) != data.size()) {
+        const QString error = transfer->file.errorString();
+        sendCancel(transfer->peer, transferId, error);
+        finishIncoming(transferId, false, error);
+        return;
+    }
+    if (offset > status.transferredBytes) {
+        // 其他条带上更靠后的区段先到，记下位置，等前缀推进到此处再计入。
+        transfer->ranges.insert(offset, end);
+        return;
+    }
+    transfer->hasher->addData(data);
+    status.transferredBytes = end;
+    if (!absorbRanges(transfer)) {
+        return;
+    }
+
+    if (status.transferredBytes >= status.totalBytes) {
+        completeIncoming(transfer);
+        return;
+    }
+    if (status.transferredBytes - transfer->committedOffset >= CheckpointInterval) {
+        commitIncoming(transfer);
+    }
+    if (status.transferredBytes - transfer->ackedOffset >= AckInterval) {
+        sendAck(transfer);
+        emit transferProgress(status);
+    }
+}
+
+bool FileTransferManager::absorbRanges(const QSharedPointer<IncomingTransfer> &transfer) {
+    FileTransferStatus &status = transfer->status;
+    while (!transfer->ranges.isEmpty() && transfer->ranges.firstKey() == status.transferredBytes) {
+        const quint64 end = transfer->ranges.take(status.transferredBytes);
+        // 刚写入的区段仍在页缓存中，读回计算哈希的代价远小于网络传输。
+        bool ok = transfer->file.seek(static_cast<qint64>(status.transferredBytes));
+        while (ok && status.transferredBytes < end) {
+            const QByteArray block = transfer->file.read(
+                static_cast<qint64>(qMin<quint64>(HashBlockSize, end - status.transferredBytes)));
+            ok = !block.isEmpty();
+            transfer->hasher->addData(block);
+            status.transferredBytes += static_cast<quint64>(block.size());
+        }
+        if (!ok) {
+            const QString error = transfer->file.errorString();
+            sendCancel(transfer->peer, status.transferId, error);
+            finishIncoming(status.transferId, false, error);
+            return false;
+        }
+    }
+    return true;
+}
+
+void FileTransferManager::handleStripeClosed(const QString &peerId, int stripe) {
+    // 批量连接上在途的数据随连接丢失，接收端的连续前缀无法再接上，只需处理经该连接发送的传输：
+    // 条带发送可能用到任一条带，单连接发送只用第 0 条。接收方向由发送端重新发起，无需处理。
+    QList<QSharedPointer<OutgoingTransfer>> affected;
+    for (const auto &transfer : std::as_const(m_outgoing)) {
+        if (transfer->status.peerId == peerId && transfer->accepted && (transfer->striped || stripe == 0)) {
+            affected.append(transfer);
+        }
+    }
+    for (const auto &transfer : std::as_const(affected)) {
+        const QString transferId = transfer->status.transferId;
+        if (transfer->contentHash.isEmpty()) {
+            finishOutgoing(transferId, false, tr("数据连接已断开"));
+            continue;
+        }
+        // 交互会话仍然可用，按已确认的位置立即重新发起续传，接收端收到新的 file_offer 后从检查点接续。
+        const TransferCheckpoint checkpoint = checkpointFor(*transfer);
+        m_outgoing.remove(transferId);
+        transfer->file.close();
+        emit checkpointUpdated(checkpoint);
+        resumeUpload(transfer->peer, checkpoint);
+    }
+}
+
+void FileTransferManager::handleSessionClosed(const QString &peerId) {
+    QStringList outgoingIds;
+    for (auto it = m_outgoing.cbegin(); it != m_outgoing.cend(); ++it) {
+        if (it.value()->status.peerId == peerId) {
+            outgoingIds.append(it.key());
+        }
+    }
+    QStringList incomingIds;
+    for (auto it = m_incoming.cbegin(); it != m_incoming.cend(); ++it) {
+        if (it.value()->status.peerId == peerId) {
+            incomingIds.append(it.key());
+        }
+    }
+    for (const QString &transferId : std::as_const(outgoingIds)) {
+        finishOutgoing(transferId, false, tr("连接已断开，重连后将自动续传"), true);
+    }
+    for (const QString &transferId : std::as_const(incomingIds)) {
+        finishIncoming(transferId, false, tr("连接已断开，重连后将自动续传"), true);
+    }
+}
+
+void FileTransferManager::sendAck(const QSharedPointer<IncomingTransfer> &transfer) {
+    transfer->ackedOffset = transfer->status.transferredBytes;
+    const QJsonObject ack{
+        {QStringLiteral("type"), QStringLiteral("file_ack")},
+        {QStringLiteral("transferId"), transfer->status.transferId},
+        {QStringLiteral("offset"), static_cast<double>(transfer->ackedOffset)}
+    };
+    m_router->sendTransferControl(transfer->peer, ack);
+}
+
+void FileTransferManager::commitIncoming(const QSharedPointer<IncomingTransfer> &transfer) {
+    if (!transfer->file.flush()) {
+        return;
+    }
+    transfer->committedOffset = transfer->status.transferredBytes;
+    emit checkpointUpdated(checkpointFor(*transfer));
+}
+
+void FileTransferManager::completeIncoming(const QSharedPointer<IncomingTransfer> &transfer) {
+    FileTransferStatus &status = transfer->status;
+    const QString partPath = transfer->file.fileName();
+    transfer->file.close();
+    if (!transfer->contentHash.isEmpty() &&
+        QString::fromLatin1(transfer->hasher->result().toHex()) != transfer->contentHash) {
+        sendCancel(transfer->peer, status.transferId, tr("文件校验失败"));
+        finishIncoming(status.transferId, false, tr("文件校验失败"));
+        return;
+    }
+    if (QFile::exists(status.localPath)) {
+        status.localPath = ShareManager::reserveIncomingPath(status.fileName);
+    }
+    if (!QFile::rename(partPath, status.localPath)) {
+        sendCancel(transfer->peer, status.transferId, tr("无法保存文件"));
+        finishIncoming(status.transferId, false, tr("无法重命名临时文件 %1").arg(partPath));
+        return;
+    }
+    sendAck(transfer);
+    finishIncoming(status.transferId, true, QString());
+}
+
+void FileTransferManager::sendCancel(const PeerInfo &peer, const QString &transferId, const QString &reason) {
+    const QJsonObject cancel{
+        {QStringLiteral("type"), QStringLiteral("file_cancel")},
+        {QStringLiteral("transferId"), transferId},
+        {QStringLiteral("reason"), reason}
+    };
+    m_router->sendTransferControl(peer, cancel);
+}
+
+void FileTransferManager::finishOutgoing(const QString &transferId, bool success, const QString &errorString,
+                                         bool keepCheckpoint) {
+    const auto transfer = m_outgoing.take(transferId);
+    if (!transfer) {
+        return;
+    }
+    transfer->file.close();
+    if (keepCheckpoint && !transfer->contentHash.isEmpty()) {
+        emit checkpointUpdated(checkpointFor(*transfer));
+    } else {
+        emit checkpointDiscarded(transferId);
+    }
+    emit transferFinished(transfer->status, success, errorString);
+}
+
+void FileTransferManager::finishIncoming(const QString &transferId, bool success, const QString &errorString,
+                                         bool keepCheckpoint) {
+    const auto transfer = m_incoming.take(transferId);
+    if (!transfer) {
+        return;
+    }
+    if (transfer->file.isOpen()) {
+        transfer->file.close();
+    }
+    if (keepCheckpoint && !transfer->contentHash.isEmpty()) {
+        // close() 已将缓冲写入文件，当前接收到的数据都可作为续传起点。
+        transfer->committedOffset = transfer->status.transferredBytes;
+        const TransferCheckpoint checkpoint = checkpointFor(*transfer);
+        m_resumableIncoming.insert(transferId, checkpoint);
+        emit checkpointUpdated(checkpoint);
+    } else {
+        if (!success) {
+            QFile::remove(transfer->file.fileName());
+        }
+        emit checkpointDiscarded(transferId);
+    }
+    emit transferFinished(transfer->status, success, errorString);
+}
+
+TransferCheckpoint FileTransferManager::checkpointFor(const OutgoingTransfer &transfer) const {
+    TransferCheckpoint checkpoint;
+    checkpoint.transferId = transfer.status.transferId;
+    checkpoint.peerId = transfer.status.peerId;
+    checkpoint.outgoing = true;
+    checkpoint.fileName = transfer.status.fileName;
+    checkpoint.localPath = transfer.status.localPath;
+    checkpoint.contentHash = transfer.contentHash;
+    checkpoint.roleId = transfer.roleId;
+    checkpoint.roleName = transfer.status.roleName;
+    checkpoint.totalSize = transfer.status.totalBytes;
+    checkpoint.committedOffset = transfer.status.transferredBytes;
+    return checkpoint;
+}
+
+TransferCheckpoint FileTransferManager::checkpointFor(const IncomingTransfer &transfer) const {
+    TransferCheckpoint checkpoint;
+    checkpoint.transferId = transfer.status.transferId;
+    checkpoint.peerId = transfer.status.peerId;
+    checkpoint.outgoing = false;
+    checkpoint.fileName = transfer.status.fileName;
+    checkpoint.localPath = transfer.status.localPath;
+    checkpoint.contentHash = transfer.contentHash;
+    checkpoint.roleName = transfer.status.roleName;
+    checkpoint.totalSize = transfer.status.totalBytes;
+    checkpoint.committedOffset = transfer.committedOffset;
+    return checkpoint;
+}
+
+void FileTransferManager::hashFileAsync(const QString &path, quint64 length, const Hasher &hasher,
+                                        std::function<void(bool)> done) {
+    QPointer<FileTransferManager> self(this);
+    QThreadPool::globalInstance()->start([self, path, length, hasher, done]() {
+        QFile file(path);
+        bool ok = file.open(QIODevice::ReadOnly);
+        quint64 remaining = length;
+        while (ok && remaining > 0) {
+            const QByteArray block = file.read(static_cast<qint64>(qMin<quint64>(HashBlockSize, remaining)));
+            if (block.isEmpty()) {
+                ok = false;
+                break;
+            }
+            hasher->addData(block);
+            remaining -= static_cast<quint64>(block.size());
+        }
+        if (self) {
+            QMetaObject::invokeMethod(self.data(), [done, ok]() { done(ok); }, Qt::QueuedConnection);
+        }
+    });
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "MessageRouter.h"
+#include "ShareTypes.h"
+
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonObject>
+#include <QMap>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+#include <functional>
+
+/*!
+ * \brief FileTransferManager 以固定大小的数据块流式收发文件，并支持断点续传。
+ *
+ * 发送端按需读取文件块，并以接收端确认的偏移量维持有限的在途窗口；接收端边收边写入
+ * 临时的 .part 文件，完成并校验内容哈希后再重命名为最终文件，两端内存占用均与文件大小无关。
+ * 传输进度以检查点的形式对外发出，由上层持久化；连接中断后保留检查点，重连时接收端先
+ * 校验已落盘前缀的哈希，发送端确认一致后从该偏移继续发送。
+ * 大文件在对端支持时按区段分散到多条并行连接发送，条带数随实测吞吐自适应增减；接收端把区段写入
+ * 预先分配的文件中对应的偏移，前缀连续后再补算哈希并确认。
+ * 与 MessageRouter 运行在同一网络线程中，直接处理路由收到的控制消息与数据块。
+ */
+class FileTransferManager : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileTransferManager(MessageRouter *router, QObject *parent = nullptr);
+
+    /*!
+     * \brief startUpload 向联系人发起文件传输，计算完内容哈希后发出传输邀请；打开文件失败时以 transferFinished 报告。
+     * \param transferId 调用方预先分配的传输 ID（如 share.download 应答中返回的 ID），为空时自动生成
+     */
+    void startUpload(const PeerInfo &peer, const QString &filePath, const QString &roleId, const QString &roleName,
+                     const QString &transferId = QString());
+    /*!
+     * \brief resumeUpload 按持久化的检查点重新发起中断的发送；源文件已变化时丢弃检查点。
+     */
+    void resumeUpload(const PeerInfo &peer, const TransferCheckpoint &checkpoint);
+    /*!
+     * \brief restoreIncoming 载入未完成的接收检查点，对端重新发起同一传输时据此续传。
+     */
+    void restoreIncoming(const QVector<TransferCheckpoint> &checkpoints);
+    void cancelTransfer(const QString &transferId);
+
+    /*!
+     * \brief handleControlMessage 处理 file_offer/file_accept/file_ack/file_cancel 控制消息。
+     */
+    void handleControlMessage(const PeerInfo &peer, const QJsonObject &payload);
+    static bool isControlMessage(const QString &type);
+
+signals:
+    void transferStarted(const FileTransferStatus &status);
+    void transferProgress(const FileTransferStatus &status);
+    void transferFinished(const FileTransferStatus &status, bool success, const QString &errorString);
+    void checkpointUpdated(const TransferCheckpoint &checkpoint);
+    void checkpointDiscarded(const QString &transferId);
+
+private slots:
+    void handleChunk(const QString &peerId, const QString &transferId, quint64 offset, const QByteArray &data);
+    void handleSessionClosed(const QString &peerId);
+    void handleStripeClosed(const QString &peerId, int stripe);
+    void handlePeerBackpressure(const QString &peerId, bool congested);
+
+private:
+    using Hasher = QSharedPointer<QCryptographicHash>;
+
+    struct OutgoingTransfer {
+        FileTransferStatus status;
+        PeerInfo peer;
+        QFile file;
+        // 零拷贝发送使用的独立文件句柄，sendfile 按显式偏移读取，不影响 file 的读取位置。
+        QSharedPointer<QFile> regionFile;
+        QString roleId;
+        QString contentHash;
+        quint64 sentOffset = 0;
+        quint64 persistedOffset = 0;
+        bool accepted = false;
+        // 条带发送状态：stripes 为当前并行连接数，每个条带单元连续写在同一连接上。
+        bool striped = false;
+        int stripes = 1;
+        int stripe = 0;
+        qint64 unitRemaining = 0;
+        // 吞吐采样：每确认一段数据计算一次速率，速率随条带数增加而提升时继续加条带，否则回退一条并保持。
+        QElapsedTimer rateClock;
+        quint64 rateBaseOffset = 0;
+        double bestRate = 0.0;
+        bool rateSettled = false;
+    };
+
+    struct IncomingTransfer {
+        FileTransferStatus status;
+        PeerInfo peer;
+        QFile file;
+        QString contentHash;
+        Hasher hasher;
+        quint64 ackedOffset = 0;
+        quint64 committedOffset = 0;
+        // 已写入但尚未与连续前缀相接的区段（起点 → 终点），前缀推进到起点时读回补算哈希。
+        QMap<quint64, quint64> ranges;
+    };
+
+    void sendOffer(const QSharedPointer<OutgoingTransfer> &transfer);
+    void handleOffer(const PeerInfo &peer, const QJsonObject &payload);
+    void acceptIncoming(const QSharedPointer<IncomingTransfer> &transfer, const QString &prefixHash);
+    void handleAccept(const QJsonObject &payload);
+    void beginSending(const QSharedPointer<OutgoingTransfer> &transfer, quint64 offset);
+    void handleAck(const QJsonObject &payload);
+    void pumpOutgoing(const QSharedPointer<OutgoingTransfer> &transfer);
+    bool nextStripe(const QSharedPointer<OutgoingTransfer> &transfer);
+    void adaptStripes(const QSharedPointer<OutgoingTransfer> &transfer);
+    bool sendRegion(const QSharedPointer<OutgoingTransfer> &transfer, qint64 length);
+    bool absorbRanges(const QSharedPointer<IncomingTransfer> &transfer);
+    void sendAck(const QSharedPointer<IncomingTransfer> &transfer);
+    void commitIncoming(const QSharedPointer<IncomingTransfer> &transfer);
+    void completeIncoming(const QSharedPointer<IncomingTransfer> &transfer);
+    void sendCancel(const PeerInfo &peer, const QString &transferId, const QString &reason);
+    void finishOutgoing(const QString &transferId, bool success, const QString &errorString, bool keepCheckpoint = false);
+    void finishIncoming(const QString &transferId, bool success, const QString &errorString, bool keepCheckpoint = false);
+    TransferCheckpoint checkpointFor(const OutgoingTransfer &transfer) const;
+    TransferCheckpoint checkpointFor(const IncomingTransfer &transfer) const;
+    void hashFileAsync(const QString &path, quint64 length, const Hasher &hasher, std::function<void(bool)> done);
+
+    MessageRouter *m_router = nullptr;
+    QHash<QString, QSharedPointer<OutgoingTransfer>> m_outgoing;
+    QHash<QString, QSharedPointer<IncomingTransfer>> m_incoming;
+    QHash<QString, TransferCheckpoint> m_resumableIncoming;
+};
@@ -26,6 +26,7 @@ constexpr int FileDialogTitle = 20004;
 constexpr int FileSelected = 20005;
 constexpr int FileSaved = 20006;
 constexpr int FileTag = 20007;
+constexpr int TransferProgress = 20008;
 } // namespace MainWindow
 
 namespace ProfileCard {
@@ -56,6 +57,10 @@ constexpr int CannotWriteConfig = 31006;
 constexpr int CannotSaveFile = 31007;
 constexpr int FileSaved = 31008;
 constexpr int ShareMissing = 31009;
+constexpr int FileTransferFailed = 31010;
+constexpr int PeerTransferUnsupported = 31011;
+constexpr int RequestFailed = 31012;
+constexpr int ShareDownloadStarted = 31013;
 } // namespace Controller
 
 namespace ProfileDialog {
@@ -0,0 +1,153 @@
+#include "MessageCodec.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QHash>
+#include <QJsonArray>
+#include <QLatin1String>
+#include <cmath>
+
+namespace MessageCodec {
+namespace {
+// 紧凑键表：下标即线路上的整数键，只能在末尾追加，不能调整已有顺序。
+const QLatin1String CompactKeys[] = {
+    QLatin1String("type"),        QLatin1String("id"),         QLatin1String("displayName"),
+    QLatin1String("timestamp"),   QLatin1String("text"),       QLatin1String("roleId"),
+    QLatin1String("roleName"),    QLatin1String("transferId"), QLatin1String("offset"),
+    QLatin1String("data"),        QLatin1String("fileName"),   QLatin1String("fileSize"),
+    QLatin1String("contentHash"), QLatin1String("reason"),     QLatin1String("prefixHash"),
+    QLatin1String("lane"),        QLatin1String("entryId"),    QLatin1String("files"),
+    QLatin1String("name"),        QLatin1String("size"),       QLatin1String("profile"),
+    QLatin1String("stripe"),      QLatin1String("messageId"),  QLatin1String("t1"),
+    QLatin1String("t2"),          QLatin1String("t3"),         QLatin1String("rpcId"),
+    QLatin1String("method"),      QLatin1String("params"),     QLatin1String("result"),
+    QLatin1String("error"),
+};
+constexpr qint64 KeyCount = static_cast<qint64>(sizeof(CompactKeys) / sizeof(CompactKeys[0]));
+
+const QHash<QString, qint64> &keyIndex() {
+    static const QHash<QString, qint64> index = [] {
+        QHash<QString, qint64> result;
+        for (qint64 i = 0; i < KeyCount; ++i) {
+            result.insert(CompactKeys[i], i);
+        }
+        return result;
+    }();
+    return index;
+}
+
+QCborValue encodeKey(const QString &key) {
+    const auto &index = keyIndex();
+    const auto it = index.constFind(key);
+    return it == index.constEnd() ? QCborValue(key) : QCborValue(it.value());
+}
+
+QString decodeKey(const QCborValue &key) {
+    if (key.isInteger()) {
+        const qint64 index = key.toInteger();
+        return index >= 0 && index < KeyCount ? QString(CompactKeys[index]) : QString();
+    }
+    return key.toString();
+}
+
+QCborValue encodeValue(const QJsonValue &value);
+
+QCborMap encodeObject(const QJsonObject &object) {
+    QCborMap map;
+    for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+        const QString key = it.key();
+        map.insert(encodeKey(key), encodeValue(it.value()));
+    }
+    return map;
+}
+
+QCborValue encodeValue(const QJsonValue &value) {
+    switch (value.type()) {
+    case QJsonValue::Object:
+        return encodeObject(value.toObject());
+    case QJsonValue::Array: {
+        QCborArray array;
+        const QJsonArray source = value.toArray();
+        for (const QJsonValue &item : source) {
+            array.append(encodeValue(item));
+        }
+        return array;
+    }
+    case QJsonValue::Double: {
+        // JSON 模型中的整数（大小、偏移量）以 CBOR 整数编码，比双精度浮点更紧凑。
+        const double number = value.toDouble();
+        double integral = 0.0;
+        if (std::modf(number, &integral) == 0.0 && std::fabs(number) < 9007199254740992.0) {
+            return QCborValue(static_cast<qint64>(number));
+        }
+        return QCborValue(number);
+    }
+    default:
+        return QCborValue::fromJsonValue(value);
+    }
+}
+
+QJsonValue decodeValue(const QCborValue &value);
+
+QJsonObject decodeObject(const QCborMap &map, QByteArray *binary) {
+    QJsonObject object;
+    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+        const QString key = decodeKey(it.key());
+        if (key.isEmpty()) {
+            continue;
+        }
+        const QCborValue value = it.value();
+        if (value.isByteArray()) {
+            if (binary && key == QLatin1String("data")) {
+                *binary = value.toByteArray();
+            } else {
+                object.insert(key, QString::fromLatin1(value.toByteArray().toBase64()));
+            }
+        } else {
+            object.insert(key, decodeValue(value));
+        }
+    }
+    return object;
+}
+
+QJsonValue decodeValue(const QCborValue &value) {
+    if (value.isMap()) {
+        return decodeObject(value.toMap(), nullptr);
+    }
+    if (value.isArray()) {
+        QJsonArray array;
+        const QCborArray source = value.toArray();
+        for (const QCborValue &item : source) {
+            array.append(decodeValue(item));
+        }
+        return array;
+    }
+    if (value.isInteger()) {
+        return static_cast<double>(value.toInteger());
+    }
+    return value.toJsonValue();
+}
+} // namespace
+
+QByteArray encodeCbor(const QJsonObject &object, const QByteArray &binary) {
+    QCborMap map = encodeObject(object);
+    if (!binary.isNull()) {
+        map.insert(encodeKey(QStringLiteral("data")), binary);
+    }
+    return QCborValue(map).toCbor();
+}
+
+bool decodeCbor(const QByteArray &payload, QJsonObject *object, QByteArray *binary) {
+    QCborParserError error;
+    const QCborValue value = QCborValue::fromCbor(payload, &error);
+    if (error.error != QCborError::NoError || !value.isMap()) {
+        return false;
+    }
+    // 只有顶层的 file_chunk 消息把 data 字节串交给调用方，其余字节串一律按 base64 字符串还原。
+    const QCborMap map = value.toMap();
+    const bool chunk = map.value(encodeKey(QStringLiteral("type"))).toString() == QLatin1String("file_chunk");
+    *object = decodeObject(map, chunk ? binary : nullptr);
+    return true;
+}
+} // namespace MessageCodec
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QByteArray>
+#include <QJsonObject>
+
+/*!
+ * \brief 路由消息的 CBOR 编码：与 JSON 消息模型一一对应的二进制表示。
+ *
+ * 常用字段名以小整数键编码，整数值（含毫秒级 timestamp）以 CBOR 整数传输；
+ * 文件数据块的 data 字段以 CBOR 字节串直接承载，不再经过 base64 膨胀，
+ * 其余字段原样编码，不做任何按字段名的转换。
+ * 解码结果仍是 QJsonObject，上层对两种编码一视同仁。
+ */
+namespace MessageCodec {
+/*!
+ * \brief encodeCbor 将消息编码为 CBOR。
+ * \param binary 非空时作为 data 字段的字节串写入，避免调用方先做 base64
+ */
+QByteArray encodeCbor(const QJsonObject &object, const QByteArray &binary = QByteArray());
+
+/*!
+ * \brief decodeCbor 解码 CBOR 消息。
+ * \param binary 非空且消息类型为 file_chunk 时，顶层 data 字段的原始字节写入该参数而不放入 object；
+ *        其余情况下字节串以 base64 字符串放入 object
+ * \return 负载不是合法的 CBOR 映射时返回 false
+ */
+bool decodeCbor(const QByteArray &payload, QJsonObject *object, QByteArray *binary = nullptr);
+} // namespace MessageCodec
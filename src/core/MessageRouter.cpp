@@ -1,12 +1,85 @@
 #include "MessageRouter.h"
 
+#include "MessageCodec.h"
+
+#include <QCryptographicHash>
 #include <QDateTime>
 #include <QHostAddress>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QRandomGenerator>
+#include <QSysInfo>
+#include <QTimer>
+
+#include <iterator>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// 批量通道每轮事件循环最多解码的字节数，超出后让出事件循环，保证交互通道的消息优先处理。
+constexpr int BulkDrainBudget = 256 * 1024;
+// 交给 QTcpSocket 内部缓冲的数据上限，其余数据留在会话队列中，随 bytesWritten 逐步写出。
+constexpr qint64 SocketBufferLimit = 256 * 1024;
+// 待发送数据（队列 + 套接字缓冲）越过高水位即视为拥塞，回落到低水位以下才解除。
+constexpr qint64 HighWatermark = 4 * 1024 * 1024;
+constexpr qint64 LowWatermark = 1024 * 1024;
+// 交互消息在拥塞时仍可入队，但总量超过硬上限后直接丢弃，防止对端失去响应时内存无限增长。
+constexpr qint64 HardLimit = 16 * 1024 * 1024;
+// 会话建立：单轮连接超时、并行尝试的地址数以及失败后的退避参数。
+constexpr int ConnectTimeoutMs = 5000;
+constexpr int MaxParallelConnects = 3;
+constexpr int MaxKnownAddresses = 4;
+constexpr int MaxConnectFailures = 5;
+constexpr int BackoffBaseMs = 500;
+constexpr int BackoffMaxMs = 15000;
+// 单次 sendfile 调用写出的上限，避免一次系统调用占用事件循环过久。
+constexpr qint64 SendfileStep = 1024 * 1024;
+// 空闲会话巡检周期。
+constexpr int IdleSweepIntervalMs = 30 * 1000;
+// 统计：吞吐时间窗长度、文件数据每隔多少字节记录一次发送时刻用于计算确认延迟、
+// 以及等待确认的样本上限（对端不回复确认时防止无限累积）。
+constexpr qint64 RateWindowMs = 1000;
+constexpr quint64 AckSampleBytes = 256 * 1024;
+constexpr int MaxPendingAckSamples = 1024;
+// 时钟探测：已建立的交互会话每隔该时间发送一次 ping，保留最近若干个样本。
+constexpr int ProbeIntervalMs = 30 * 1000;
+constexpr int ClockSampleCount = 8;
+// 加密握手须在该时间内完成，否则断开连接，避免发送队列无限期暂停。
+constexpr int HandshakeTimeoutMs = 5000;
+// 重复连接合并：被淘汰的连接在对端确认或静默该时长后关闭，对端不回复确认时最多保留 RetireTimeoutMs。
+constexpr int RetireQuietMs = 2000;
+constexpr qint64 RetireTimeoutMs = 30 * 1000;
+// 同机批量连接的套接字缓冲，Unix 域套接字默认缓冲较小，放大后单次 sendfile 能搬运更多数据。
+constexpr int LocalBulkBufferSize = 4 * 1024 * 1024;
+constexpr int LatencyBounds[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
 
-MessageRouter::MessageRouter(QObject *parent) : QObject(parent) {
+// JSON 编码没有字节串类型，二进制内容以 base64 字符串写入 data 字段。
+QJsonObject withBinary(const QJsonObject &object, const QByteArray &binary) {
+    if (binary.isNull()) {
+        return object;
+    }
+    QJsonObject result = object;
+    result.insert(QStringLiteral("data"), QString::fromLatin1(binary.toBase64()));
+    return result;
+}
+} // namespace
+
+MessageRouter::MessageRouter(QObject *parent)
+    : QObject(parent), m_server(this), m_idleTimer(this), m_probeTimer(this) {
     connect(&m_server, &QTcpServer::newConnection, this, &MessageRouter::handleNewConnection);
+    m_idleTimer.setInterval(IdleSweepIntervalMs);
+    connect(&m_idleTimer, &QTimer::timeout, this, &MessageRouter::reapIdleSessions);
+    m_probeTimer.setInterval(ProbeIntervalMs);
+    connect(&m_probeTimer, &QTimer::timeout, this, &MessageRouter::probeSessions);
+    m_clock.start();
 }
 
 bool MessageRouter::startListening(quint16 port) {
@@ -18,7 +91,169 @@ bool MessageRouter::startListening(quint16 port) {
         emit routerWarning(tr("无法监听 TCP 端口 %1: %2").arg(port).arg(m_server.errorString()));
         return false;
     }
+    // 同机直连的监听失败不影响 TCP，联系人之间退回回环地址通信。
+    startLocalListener(port);
+    // 定时器需在路由所在的网络线程中启动。
+    m_idleTimer.start();
+    m_probeTimer.start();
+    return true;
+}
+
+QString MessageRouter::hostIdentity() {
+    static const QString identity = [] {
+        const QByteArray machineId = QSysInfo::machineUniqueId();
+        if (machineId.isEmpty()) {
+            return QString();
+        }
+        // 只广播摘要，不在局域网上暴露机器 ID 本身。
+        return QString::fromLatin1(
+            QCryptographicHash::hash(machineId + QByteArrayLiteral("/nwt"), QCryptographicHash::Sha256)
+                .toHex()
+                .left(16));
+    }();
+    return identity;
+}
+
+bool MessageRouter::isSameHost(const PeerInfo &peer) const {
+    // 由同一镜像克隆出的主机可能共用机器 ID：端点与本机监听名相同时必然是另一台主机上的同端口实例，
+    // 连过去只会连回本进程自己。
+    return !m_localEndpoint.isEmpty() && !peer.localEndpoint.isEmpty() && !peer.hostId.isEmpty() &&
+           peer.hostId == hostIdentity() && peer.localEndpoint != m_localEndpoint;
+}
+
+#ifdef Q_OS_LINUX
+namespace {
+// 抽象命名空间地址：sun_path 首字节为 0，不在文件系统中留下套接字文件，进程退出即自动释放，
+// 不同用户的进程之间也无需共享目录权限即可连接。
+socklen_t localSocketAddress(const QString &name, sockaddr_un *address) {
+    const QByteArray bytes = name.toLatin1();
+    if (bytes.isEmpty() || bytes.size() + 1 > static_cast<int>(sizeof(address->sun_path))) {
+        return 0;
+    }
+    std::memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    std::memcpy(address->sun_path + 1, bytes.constData(), static_cast<size_t>(bytes.size()));
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + static_cast<size_t>(bytes.size()));
+}
+} // namespace
+#endif
+
+bool MessageRouter::startLocalListener(quint16 port) {
+    closeLocalListener();
+#ifdef Q_OS_LINUX
+    if (hostIdentity().isEmpty()) {
+        return false;
+    }
+    // TCP 端口在本机唯一，以其命名即可避免同机多个实例互相冲突。
+    const QString name = QStringLiteral("nwt.%1").arg(port);
+    sockaddr_un address;
+    const socklen_t length = localSocketAddress(name, &address);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), length) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_localListenFd = fd;
+    m_localEndpoint = name;
+    m_localNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(m_localNotifier, &QSocketNotifier::activated, this, &MessageRouter::acceptLocalConnections);
     return true;
+#else
+    Q_UNUSED(port);
+    return false;
+#endif
+}
+
+void MessageRouter::closeLocalListener() {
+    delete m_localNotifier;
+    m_localNotifier = nullptr;
+#ifdef Q_OS_LINUX
+    if (m_localListenFd >= 0) {
+        ::close(m_localListenFd);
+    }
+#endif
+    m_localListenFd = -1;
+    m_localEndpoint.clear();
+}
+
+void MessageRouter::acceptLocalConnections() {
+#ifdef Q_OS_LINUX
+    for (;;) {
+        const int fd = ::accept4(m_localListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (QTcpSocket *socket = adoptLocalSocket(fd)) {
+            applyLaneSocketOptions(socket, Lane::Interactive);
+        }
+    }
+#endif
+}
+
+QTcpSocket *MessageRouter::adoptLocalSocket(int fd) {
+#ifdef Q_OS_LINUX
+    // QTcpSocket 可以接管任意已连接的流式套接字描述符，分帧、会话管理与 sendfile 路径与 TCP 连接完全相同。
+    auto *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(fd)) {
+        ::close(fd);
+        delete socket;
+        return nullptr;
+    }
+    attachSocketSignals(socket);
+    m_socketStates[socket].local = true;
+    return socket;
+#else
+    Q_UNUSED(fd);
+    return nullptr;
+#endif
+}
+
+QTcpSocket *MessageRouter::connectLocal(const PeerInfo &peer, Lane lane, int stripe) {
+#ifdef Q_OS_LINUX
+    sockaddr_un address;
+    const socklen_t length = localSocketAddress(peer.localEndpoint, &address);
+    if (length == 0) {
+        return nullptr;
+    }
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // 本机连接要么立即建立，要么因对端未监听或积压队列已满而失败，失败时退回 TCP。
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), length) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    // 再以对端进程凭据兜底：连到的是本进程自己的监听端点时放弃，退回 TCP。
+    ucred credentials{};
+    socklen_t credentialsLength = sizeof(credentials);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentialsLength) != 0 ||
+        credentials.pid == ::getpid()) {
+        ::close(fd);
+        return nullptr;
+    }
+    QTcpSocket *socket = adoptLocalSocket(fd);
+    if (!socket) {
+        return nullptr;
+    }
+    SocketState &state = m_socketStates[socket];
+    // 同机传输不值得压缩，只保留分帧与 CBOR 编码。
+    state.framed = true;
+    state.cbor = peer.supports(PeerCapability::CborEncoding);
+    state.lane = lane;
+    state.stripe = stripe;
+    state.initiatedLocally = true;
+    applyLaneSocketOptions(socket, lane);
+    return socket;
+#else
+    Q_UNUSED(peer);
+    Q_UNUSED(lane);
+    Q_UNUSED(stripe);
+    return nullptr;
+#endif
 }
 
 void MessageRouter::setLocalPeerId(const QString &peerId) {
@@ -29,15 +264,42 @@ void MessageRouter::setLocalDisplayName(const QString &name) {
     m_localDisplayName = name;
 }
 
-void MessageRouter::sendChatMessage(const PeerInfo &peer, const QString &text, const QString &roleId,
-                                    const QString &roleName) {
-    if (text.isEmpty()) {
+void MessageRouter::rememberPeer(const PeerInfo &peer) {
+    if (peer.id.isEmpty()) {
         return;
     }
+    m_knownPeers.insert(peer.id, peer);
+    if (!peer.address.isNull()) {
+        // 记录对端最近出现过的多个地址（多网卡、多网段），建立会话时并行尝试。
+        QList<QHostAddress> &addresses = m_peerAddresses[peer.id];
+        addresses.removeAll(peer.address);
+        addresses.prepend(peer.address);
+        while (addresses.size() > MaxKnownAddresses) {
+            addresses.removeLast();
+        }
+    }
+}
 
-    QTcpSocket *socket = ensureSession(peer);
-    if (!socket) {
-        emit routerWarning(tr("无法与 %1 建立会话").arg(peer.displayName));
+QString MessageRouter::localCapabilities() {
+    QStringList capabilities{QString::fromLatin1(PeerCapability::Framing),
+                                   QString::fromLatin1(PeerCapability::ChunkedTransfer),
+                                   QString::fromLatin1(PeerCapability::BulkLane),
+                                   QString::fromLatin1(PeerCapability::CborEncoding),
+                                   QString::fromLatin1(PeerCapability::Compression),
+                                   QString::fromLatin1(PeerCapability::FileRegion),
+                                   QString::fromLatin1(PeerCapability::Striping),
+                                   QString::fromLatin1(PeerCapability::DeliveryAck),
+                                   QString::fromLatin1(PeerCapability::ClockSync),
+                                   QString::fromLatin1(PeerCapability::Rpc)};
+    if (SessionCrypto::available()) {
+        capabilities.append(QString::fromLatin1(PeerCapability::SealedSession));
+    }
+    return capabilities.join(QLatin1Char(','));
+}
+
+void MessageRouter::sendChatMessage(const PeerInfo &peer, const QString &text, const QString &roleId,
+                                    const QString &roleName, const QString &messageId, const QDateTime &sentAt) {
+    if (text.isEmpty()) {
         return;
     }
 
@@ -45,151 +307,1711 @@ void MessageRouter::sendChatMessage(const PeerInfo &peer, const QString &text, c
         {QStringLiteral("type"), QStringLiteral("chat")},
         {QStringLiteral("id"), m_localPeerId},
         {QStringLiteral("displayName"), m_localDisplayName},
-        {QStringLiteral("timestamp"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+        {QStringLiteral("timestamp"),
+         static_cast<double>(sentAt.isValid() ? sentAt.toMSecsSinceEpoch() : QDateTime::currentMSecsSinceEpoch())},
         {QStringLiteral("text"), text},
         {QStringLiteral("roleId"), roleId},
         {QStringLiteral("roleName"), roleName}
     };
-    sendJson(socket, obj);
+    if (!messageId.isEmpty()) {
+        obj.insert(QStringLiteral("messageId"), messageId);
+        auto &pendingAcks = m_peerCounters[peer.id].pendingAcks;
+        if (pendingAcks.size() < MaxPendingAckSamples) {
+            pendingAcks.insert(messageId, m_clock.elapsed());
+        }
+    }
+    if (!sendToPeer(peer, Lane::Interactive, obj, MessageClass::Interactive) && messageId.isEmpty()) {
+        // 带 ID 的消息保留在发件箱中，稍后会重发，无需提示。
+        emit routerWarning(tr("%1 长时间未接收数据，消息已丢弃").arg(peer.displayName));
+    }
+}
+
+void MessageRouter::sendDeliveryAck(const PeerInfo &peer, const QString &messageId) {
+    const QJsonObject ack{
+        {QStringLiteral("type"), QStringLiteral("chat_ack")},
+        {QStringLiteral("id"), m_localPeerId},
+        {QStringLiteral("messageId"), messageId}
+    };
+    sendToPeer(peer, Lane::Interactive, ack, MessageClass::Control);
 }
 
 void MessageRouter::sendFilePayload(const PeerInfo &peer, const QString &roleId, const QString &roleName,
                                     const QJsonObject &fileInfo) {
-    QTcpSocket *socket = ensureSession(peer);
-    if (!socket) {
-        emit routerWarning(tr("无法与 %1 建立文件会话").arg(peer.displayName));
-        return;
-    }
-
     QJsonObject payload = fileInfo;
     payload.insert(QStringLiteral("type"), QStringLiteral("file"));
     payload.insert(QStringLiteral("id"), m_localPeerId);
     payload.insert(QStringLiteral("displayName"), m_localDisplayName);
-    payload.insert(QStringLiteral("timestamp"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    payload.insert(QStringLiteral("timestamp"), static_cast<double>(QDateTime::currentMSecsSinceEpoch()));
     payload.insert(QStringLiteral("roleId"), roleId);
     payload.insert(QStringLiteral("roleName"), roleName);
-    sendJson(socket, payload);
+    if (!sendToPeer(peer, Lane::Interactive, payload, MessageClass::Bulk)) {
+        emit routerWarning(tr("%1 接收缓慢，请稍后重新发送文件").arg(peer.displayName));
+    }
 }
 
 void MessageRouter::sendSharePayload(const PeerInfo &peer, const QJsonObject &payload) {
-    QTcpSocket *socket = ensureSession(peer);
-    if (!socket) {
-        emit routerWarning(tr("无法向 %1 发送共享数据").arg(peer.displayName));
-        return;
+    QJsonObject object = payload;
+    object.insert(QStringLiteral("type"), object.value(QStringLiteral("type")).toString());
+    object.insert(QStringLiteral("id"), m_localPeerId);
+    object.insert(QStringLiteral("displayName"), m_localDisplayName);
+    object.insert(QStringLiteral("timestamp"), static_cast<double>(QDateTime::currentMSecsSinceEpoch()));
+    if (!sendToPeer(peer, Lane::Interactive, object, MessageClass::Interactive)) {
+        emit routerWarning(tr("%1 长时间未接收数据，共享数据已丢弃").arg(peer.displayName));
     }
+}
 
+void MessageRouter::sendTransferControl(const PeerInfo &peer, const QJsonObject &payload) {
     QJsonObject object = payload;
-    object.insert(QStringLiteral("type"), object.value(QStringLiteral("type")).toString());
     object.insert(QStringLiteral("id"), m_localPeerId);
     object.insert(QStringLiteral("displayName"), m_localDisplayName);
-    object.insert(QStringLiteral("timestamp"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
-    sendJson(socket, object);
+    object.insert(QStringLiteral("timestamp"), static_cast<double>(QDateTime::currentMSecsSinceEpoch()));
+    if (!sendToPeer(peer, Lane::Interactive, object, MessageClass::Control)) {
+        emit routerWarning(tr("无法与 %1 建立文件会话").arg(peer.displayName));
+    }
 }
 
-void MessageRouter::handleNewConnection() {
-    while (m_server.hasPendingConnections()) {
-        QTcpSocket *socket = m_server.nextPendingConnection();
-        attachSocketSignals(socket);
+bool MessageRouter::sendRpcMessage(const PeerInfo &peer, const QJsonObject &payload) {
+    QJsonObject object = payload;
+    object.insert(QStringLiteral("id"), m_localPeerId);
+    return sendToPeer(peer, Lane::Interactive, object, MessageClass::Interactive);
+}
+
+bool MessageRouter::sendFileChunk(const PeerInfo &peer, const QString &transferId, quint64 offset,
+                                  const QByteArray &data, int stripe) {
+    // 数据块只携带定位所需的最少字段，避免每块重复发送昵称与时间戳；数据内容由编码层按连接决定是否 base64。
+    const QJsonObject object{
+        {QStringLiteral("type"), QStringLiteral("file_chunk")},
+        {QStringLiteral("id"), m_localPeerId},
+        {QStringLiteral("transferId"), transferId},
+        {QStringLiteral("offset"), static_cast<double>(offset)}
+    };
+    if (!sendToPeer(peer, Lane::Bulk, object, MessageClass::Bulk, data, stripe)) {
+        return false;
     }
+    markChunkSent(peer.id, transferId, offset + static_cast<quint64>(data.size()));
+    return true;
 }
 
-void MessageRouter::readSocket() {
-    auto *socket = qobject_cast<QTcpSocket *>(sender());
-    if (!socket) {
+bool MessageRouter::canStripe(const PeerInfo &peer) const {
+    return peer.supports(PeerCapability::Striping) && peer.supports(PeerCapability::BulkLane);
+}
+
+bool MessageRouter::canSendFileRegion(const PeerInfo &peer) const {
+#ifdef Q_OS_LINUX
+    return peer.supports(PeerCapability::FileRegion) && peer.supports(PeerCapability::BulkLane);
+#else
+    Q_UNUSED(peer);
+    return false;
+#endif
+}
+
+bool MessageRouter::sendFileRegion(const PeerInfo &peer, const QString &transferId, quint64 offset,
+                                   const QSharedPointer<QFile> &file, qint64 length, int stripe) {
+    if (!file || length <= 0 || !canSendFileRegion(peer)) {
+        return false;
+    }
+    PendingMessage message;
+    message.object.insert(QStringLiteral("transferId"), transferId);
+    message.file = file;
+    message.fileOffset = static_cast<qint64>(offset);
+    message.fileLength = length;
+    if (!sendToPeer(peer, Lane::Bulk, message, MessageClass::Bulk, stripe)) {
+        return false;
+    }
+    markChunkSent(peer.id, transferId, offset + static_cast<quint64>(length));
+    return true;
+}
+
+void MessageRouter::setWriteBatching(bool enabled) {
+    m_writeBatching = enabled;
+}
+
+void MessageRouter::setSessionLimits(int maxSessions, int idleTimeoutSeconds) {
+    m_maxSessions = qMax(1, maxSessions);
+    m_idleTimeoutMs = static_cast<qint64>(qMax(1, idleTimeoutSeconds)) * 1000;
+    enforcePoolLimit(nullptr);
+}
+
+QVector<int> MessageRouter::latencyBucketBounds() {
+    return QVector<int>(std::begin(LatencyBounds), std::end(LatencyBounds));
+}
+
+QVector<MessageRouter::SessionStats> MessageRouter::sessionStats() const {
+    QVector<SessionStats> result;
+    const qint64 now = m_clock.elapsed();
+    const auto collect = [&](const QHash<QString, QPointer<QTcpSocket>> &sessions) {
+        for (const QPointer<QTcpSocket> &socket : sessions) {
+            const auto state = socket.isNull() ? m_socketStates.constEnd() : m_socketStates.constFind(socket.data());
+            if (state == m_socketStates.constEnd()) {
+                continue;
+            }
+            SessionStats stats;
+            stats.peerId = m_socketToPeer.value(socket.data());
+            stats.bulk = state->lane == Lane::Bulk;
+            stats.stripe = state->stripe;
+            stats.encrypted = state->sealed;
+            stats.local = state->local;
+            stats.address = state->local ? m_knownPeers.value(stats.peerId).localEndpoint
+                                         : socket->peerAddress().toString();
+            stats.connectedMs = now - state->connectedAt;
+            stats.bytesIn = state->bytesIn;
+            stats.bytesOut = state->bytesOut;
+            stats.messagesIn = state->messagesIn;
+            stats.messagesOut = state->messagesOut;
+            stats.queuedBytes = state->queuedBytes + socket->bytesToWrite();
+            stats.queuedMessages = state->outbound.size();
+            stats.congested = state->congested;
+            stats.inRate = state->inRate.current(now);
+            stats.outRate = state->outRate.current(now);
+            const auto counters = m_peerCounters.constFind(stats.peerId);
+            if (counters != m_peerCounters.constEnd()) {
+                stats.reconnects = counters->reconnects;
+                stats.ackLatency = QVector<quint64>(counters->ackLatency.cbegin(), counters->ackLatency.cend());
+            } else {
+                stats.ackLatency = QVector<quint64>(LatencyBucketCount, 0);
+            }
+            const auto clock = m_clocks.constFind(stats.peerId);
+            if (clock != m_clocks.constEnd()) {
+                stats.rttMs = clock->rtt;
+                stats.clockOffsetMs = clock->offset;
+            }
+            result.append(stats);
+        }
+    };
+    collect(m_peerSessions);
+    collect(m_bulkSessions);
+    return result;
+}
+
+void MessageRouter::RateWindow::add(qint64 now, quint64 count) {
+    if (now - start >= RateWindowMs) {
+        rate = start > 0 || bytes > 0 ? static_cast<double>(bytes) * 1000.0 / static_cast<double>(now - start) : 0.0;
+        start = now;
+        bytes = 0;
+    }
+    bytes += count;
+}
+
+double MessageRouter::RateWindow::current(qint64 now) const {
+    // 超过两个窗口没有数据说明已经停止收发，不再报告上一窗口的速率。
+    return now - start >= 2 * RateWindowMs ? 0.0 : rate;
+}
+
+void MessageRouter::countBytesOut(SocketState &state, quint64 count) {
+    state.bytesOut += count;
+    state.outRate.add(m_clock.elapsed(), count);
+}
+
+void MessageRouter::markChunkSent(const QString &peerId, const QString &transferId, quint64 end) {
+    // 每隔 AckSampleBytes 记录一次发送时刻，收到覆盖该偏移的 file_ack 时即得到一个延迟样本。
+    auto &marks = m_peerCounters[peerId].chunkMarks[transferId];
+    const quint64 last = marks.isEmpty() ? 0 : marks.lastKey();
+    if (marks.size() < MaxPendingAckSamples && (marks.isEmpty() || end - last >= AckSampleBytes)) {
+        marks.insert(end, m_clock.elapsed());
+    }
+}
+
+void MessageRouter::recordAckLatency(const QString &peerId, qint64 sentAt) {
+    const qint64 latency = m_clock.elapsed() - sentAt;
+    int bucket = 0;
+    while (bucket < LatencyBucketCount - 1 && latency > LatencyBounds[bucket]) {
+        ++bucket;
+    }
+    ++m_peerCounters[peerId].ackLatency[static_cast<size_t>(bucket)];
+}
+
+void MessageRouter::handleAckForStats(const QString &peerId, const QString &type, const QJsonObject &object) {
+    auto counters = m_peerCounters.find(peerId);
+    if (counters == m_peerCounters.end()) {
+        return;
+    }
+    if (type == QStringLiteral("chat_ack")) {
+        const auto pending = counters->pendingAcks.find(object.value(QStringLiteral("messageId")).toString());
+        if (pending != counters->pendingAcks.end()) {
+            const qint64 sentAt = pending.value();
+            counters->pendingAcks.erase(pending);
+            recordAckLatency(peerId, sentAt);
+        }
+        return;
+    }
+    const QString transferId = object.value(QStringLiteral("transferId")).toString();
+    auto marks = counters->chunkMarks.find(transferId);
+    if (marks == counters->chunkMarks.end()) {
+        return;
+    }
+    if (type == QStringLiteral("file_cancel")) {
+        counters->chunkMarks.erase(marks);
         return;
     }
+    // 取确认偏移覆盖到的最后一个样本计算延迟，更早的样本一并丢弃。
+    const quint64 offset = static_cast<quint64>(object.value(QStringLiteral("offset")).toDouble());
+    qint64 sentAt = -1;
+    while (!marks->isEmpty() && marks->firstKey() <= offset) {
+        sentAt = marks->take(marks->firstKey());
+    }
+    if (marks->isEmpty()) {
+        counters->chunkMarks.erase(marks);
+    }
+    if (sentAt >= 0) {
+        recordAckLatency(peerId, sentAt);
+    }
+}
 
-    QByteArray &buffer = m_pendingBuffers[socket];
-    buffer.append(socket->readAll());
+bool MessageRouter::canSeal(const PeerInfo &peer) const {
+    return SessionCrypto::available() && peer.supports(PeerCapability::SealedSession) &&
+           peer.supports(PeerCapability::Framing);
+}
 
-    int newline = buffer.indexOf('\n');
-    while (newline != -1) {
-        const QByteArray line = buffer.left(newline);
-        buffer.remove(0, newline + 1);
+void MessageRouter::beginSeal(QTcpSocket *socket, const QString &peerId) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end() || !state->framed || state->local) {
+        return;
+    }
+    state->sealing = true;
+    state->sealNonce = SessionCrypto::randomBytes(SessionCrypto::NonceSize);
+    QJsonObject hello{
+        {QStringLiteral("type"), QStringLiteral("seal_hello")},
+        {QStringLiteral("id"), m_localPeerId},
+        {QStringLiteral("nonce"), QString::fromLatin1(state->sealNonce.toBase64())}
+    };
+    const auto ticket = m_sessionTickets.constFind(peerId);
+    state->sealResuming = ticket != m_sessionTickets.constEnd();
+    if (state->sealResuming) {
+        // 持有票据时只发送票据，双方都省去 X25519 运算。
+        hello.insert(QStringLiteral("ticket"), QString::fromLatin1(ticket->ticket.toBase64()));
+    } else {
+        QByteArray publicKey;
+        if (!SessionCrypto::generateKeyPair(&state->sealPrivate, &publicKey)) {
+            state->sealing = false;
+            socket->abort();
+            return;
+        }
+        hello.insert(QStringLiteral("pub"), QString::fromLatin1(publicKey.toBase64()));
+    }
+    writeHandshake(socket, hello);
 
-        const QJsonDocument doc = QJsonDocument::fromJson(line);
-        if (!doc.isObject()) {
-            newline = buffer.indexOf('\n');
-            continue;
+    QPointer<QTcpSocket> guard(socket);
+    QTimer::singleShot(HandshakeTimeoutMs, this, [this, guard]() {
+        if (!guard) {
+            return;
         }
+        const auto pending = m_socketStates.constFind(guard.data());
+        if (pending != m_socketStates.constEnd() && pending->sealing) {
+            emit routerWarning(tr("与 %1 的加密握手超时").arg(guard->peerAddress().toString()));
+            guard->abort();
+        }
+    });
+}
+
+void MessageRouter::writeHandshake(QTcpSocket *socket, const QJsonObject &object) {
+    // 握手消息始终以明文 JSON 帧直接写出，不经过发送队列（队列在握手期间暂停）。
+    const QByteArray frame = WireProtocol::encodeFrame(WireProtocol::FrameType::Json, WireProtocol::NoFlags,
+                                                       QJsonDocument(object).toJson(QJsonDocument::Compact));
+    auto state = m_socketStates.find(socket);
+    if (state != m_socketStates.end()) {
+        ++state->messagesOut;
+        countBytesOut(*state, static_cast<quint64>(frame.size()));
+    }
+    socket->write(frame);
+}
+
+void MessageRouter::handleSealHandshake(QTcpSocket *socket, const QString &type, const QJsonObject &object) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end()) {
+        return;
+    }
+    const QString peerId = object.value(QStringLiteral("id")).toString();
+    const QByteArray nonce = QByteArray::fromBase64(object.value(QStringLiteral("nonce")).toString().toLatin1());
 
-        const QJsonObject obj = doc.object();
-        PeerInfo peer;
-        peer.id = obj.value(QStringLiteral("id")).toString();
-        peer.displayName = obj.value(QStringLiteral("displayName")).toString();
-        peer.address = socket->peerAddress();
-        peer.listenPort = static_cast<quint16>(socket->peerPort());
-        peer.lastSeen = QDateTime::currentDateTimeUtc();
-        if (!peer.id.isEmpty()) {
-            m_socketToPeer.insert(socket, peer.id);
-            if (!m_peerSessions.contains(peer.id)) {
-                m_peerSessions.insert(peer.id, socket);
+    if (type == QStringLiteral("seal_hello")) {
+        // 服务端：凭票据恢复或完成 X25519 交换，回复后立即切换为加密收发。
+        const QByteArray ticket = QByteArray::fromBase64(object.value(QStringLiteral("ticket")).toString().toLatin1());
+        QByteArray secret;
+        QJsonObject reply{{QStringLiteral("id"), m_localPeerId}};
+        bool accepted = SessionCrypto::available() && !state->sealed && !peerId.isEmpty() &&
+                        nonce.size() == SessionCrypto::NonceSize;
+        if (accepted && !ticket.isEmpty()) {
+            accepted = SessionCrypto::redeemTicket(ticket, peerId, &secret);
+        } else if (accepted) {
+            QByteArray privateKey;
+            QByteArray publicKey;
+            accepted = SessionCrypto::generateKeyPair(&privateKey, &publicKey);
+            if (accepted) {
+                secret = SessionCrypto::sharedSecret(
+                    privateKey, QByteArray::fromBase64(object.value(QStringLiteral("pub")).toString().toLatin1()));
+                reply.insert(QStringLiteral("pub"), QString::fromLatin1(publicKey.toBase64()));
+                accepted = !secret.isEmpty();
             }
         }
+        const QByteArray serverNonce = SessionCrypto::randomBytes(SessionCrypto::NonceSize);
+        SessionCrypto::SessionKeys keys;
+        accepted = accepted && SessionCrypto::deriveSessionKeys(secret, nonce, serverNonce, &keys) &&
+                   state->sendCipher.init(keys.serverKey, keys.serverSalt) &&
+                   state->recvCipher.init(keys.clientKey, keys.clientSalt);
+        if (!accepted) {
+            writeHandshake(socket, QJsonObject{{QStringLiteral("type"), QStringLiteral("seal_reject")},
+                                               {QStringLiteral("id"), m_localPeerId}});
+            return;
+        }
+        reply.insert(QStringLiteral("type"), QStringLiteral("seal_accept"));
+        reply.insert(QStringLiteral("nonce"), QString::fromLatin1(serverNonce.toBase64()));
+        reply.insert(QStringLiteral("ticket"),
+                     QString::fromLatin1(SessionCrypto::issueTicket(keys.resumeSecret, peerId).toBase64()));
+        writeHandshake(socket, reply);
+        state->sealed = true;
+        return;
+    }
+
+    if (!state->sealing) {
+        return;
+    }
+    const QString remoteId = m_socketToPeer.value(socket);
+    if (type == QStringLiteral("seal_reject")) {
+        if (state->sealResuming) {
+            // 票据已失效（对端重启或过期），丢弃后改走完整的密钥交换。
+            m_sessionTickets.remove(remoteId);
+            beginSeal(socket, remoteId);
+            return;
+        }
+        emit routerWarning(tr("%1 拒绝了加密会话").arg(socket->peerAddress().toString()));
+        socket->abort();
+        return;
+    }
 
-        emit messageReceived(peer, obj);
-        newline = buffer.indexOf('\n');
+    // 客户端：seal_accept。
+    QByteArray secret;
+    if (state->sealResuming) {
+        secret = m_sessionTickets.value(remoteId).secret;
+    } else {
+        secret = SessionCrypto::sharedSecret(
+            state->sealPrivate, QByteArray::fromBase64(object.value(QStringLiteral("pub")).toString().toLatin1()));
+    }
+    SessionCrypto::SessionKeys keys;
+    if (secret.isEmpty() || nonce.size() != SessionCrypto::NonceSize ||
+        !SessionCrypto::deriveSessionKeys(secret, state->sealNonce, nonce, &keys) ||
+        !state->sendCipher.init(keys.clientKey, keys.clientSalt) ||
+        !state->recvCipher.init(keys.serverKey, keys.serverSalt)) {
+        emit routerWarning(tr("与 %1 的加密握手失败").arg(socket->peerAddress().toString()));
+        socket->abort();
+        return;
     }
+    const QByteArray ticket = QByteArray::fromBase64(object.value(QStringLiteral("ticket")).toString().toLatin1());
+    if (!remoteId.isEmpty() && !ticket.isEmpty()) {
+        m_sessionTickets.insert(remoteId, SessionTicket{ticket, keys.resumeSecret});
+    }
+    state->sealing = false;
+    state->sealResuming = false;
+    state->sealed = true;
+    state->sealPrivate.clear();
+    state->sealNonce.clear();
+    flushOutbound(socket);
 }
 
-QTcpSocket *MessageRouter::ensureSession(const PeerInfo &peer) {
-    if (peer.id.isEmpty()) {
-        return nullptr;
+bool MessageRouter::refusesPlaintext(QTcpSocket *socket, quint16 flags, const QString &peerId) {
+    if (flags & WireProtocol::Sealed) {
+        return false;
+    }
+    const auto state = m_socketStates.constFind(socket);
+    if (state == m_socketStates.constEnd() || state->sealed || state->local) {
+        return false;
+    }
+    // 双方都支持加密时发起方必然先握手：此时的明文帧说明握手被丢弃或遭到篡改，不能退回明文会话。
+    const auto known = m_knownPeers.constFind(peerId);
+    if (known == m_knownPeers.constEnd() || !canSeal(known.value())) {
+        return false;
+    }
+    emit routerWarning(tr("%1 未加密发送数据，已断开连接").arg(socket->peerAddress().toString()));
+    socket->abort();
+    return true;
+}
+
+bool MessageRouter::openSealedFrame(QTcpSocket *socket, WireProtocol::Frame *frame) {
+    auto state = m_socketStates.find(socket);
+    const bool sealed = state != m_socketStates.end() && state->sealed;
+    if (!(frame->flags & WireProtocol::Sealed)) {
+        // 加密会话建立后不再接受明文帧，防止被插入伪造的消息。
+        return !sealed;
     }
+    const int length = frame->payload.size() - SessionCrypto::TagSize;
+    bool ok = sealed && length >= 0;
+    if (ok) {
+        WireProtocol::FrameHeader header;
+        header.type = frame->type;
+        header.flags = frame->flags;
+        header.length = static_cast<quint32>(frame->payload.size());
+        char aad[WireProtocol::HeaderSize];
+        WireProtocol::writeHeader(aad, header);
+        char *data = frame->payload.data();
+        ok = state->recvCipher.open(data, length, aad, WireProtocol::HeaderSize, data + length);
+    }
+    if (!ok) {
+        emit routerWarning(tr("收到无法解密的数据帧，已断开与 %1 的连接").arg(socket->peerAddress().toString()));
+        socket->abort();
+        return false;
+    }
+    frame->payload.truncate(length);
+    return true;
+}
 
-    auto existing = m_peerSessions.value(peer.id);
-    if (!existing.isNull() && existing->state() != QAbstractSocket::UnconnectedState) {
-        return existing.data();
+void MessageRouter::probeSessions() {
+    const QList<QPointer<QTcpSocket>> sessions = m_peerSessions.values();
+    for (const QPointer<QTcpSocket> &socket : sessions) {
+        if (socket.isNull() || socket->state() != QAbstractSocket::ConnectedState ||
+            !m_knownPeers.value(m_socketToPeer.value(socket.data())).supports(PeerCapability::ClockSync)) {
+            continue;
+        }
+        sendProbe(socket.data(), QJsonObject{{QStringLiteral("type"), QStringLiteral("ping")}});
     }
+}
 
-    auto *socket = new QTcpSocket(this);
-    attachSocketSignals(socket);
-    socket->connectToHost(peer.address, peer.listenPort);
-    m_peerSessions.insert(peer.id, socket);
-    m_socketToPeer.insert(socket, peer.id);
-    return socket;
+void MessageRouter::sendProbe(QTcpSocket *socket, const QJsonObject &object) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end() || state->retiring) {
+        return;
+    }
+    const qint64 previousActivity = state->lastActivity;
+    QJsonObject probe = object;
+    probe.insert(QStringLiteral("id"), m_localPeerId);
+    if (probe.value(QStringLiteral("type")).toString() == QStringLiteral("ping")) {
+        probe.insert(QStringLiteral("t1"), static_cast<double>(QDateTime::currentMSecsSinceEpoch()));
+    } else {
+        probe.insert(QStringLiteral("t3"), static_cast<double>(QDateTime::currentMSecsSinceEpoch()));
+    }
+    sendMessage(socket, probe, MessageClass::Control);
+    state = m_socketStates.find(socket);
+    if (state != m_socketStates.end()) {
+        state->lastActivity = previousActivity;
+    }
 }
 
-void MessageRouter::attachSocketSignals(QTcpSocket *socket) {
-    connect(socket, &QTcpSocket::readyRead, this, &MessageRouter::readSocket);
-    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
-        cleanupSocket(socket);
-        socket->deleteLater();
-    });
+void MessageRouter::handleClockProbe(QTcpSocket *socket, const QString &type, const QJsonObject &object) {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (type == QStringLiteral("ping")) {
+        sendProbe(socket, QJsonObject{{QStringLiteral("type"), QStringLiteral("pong")},
+                                      {QStringLiteral("t1"), object.value(QStringLiteral("t1"))},
+                                      {QStringLiteral("t2"), static_cast<double>(now)}});
+        return;
+    }
+
+    // NTP 式估计：t1/t4 为本机发送与接收时刻，t2/t3 为对端接收与回复时刻。
+    const QString peerId = m_socketToPeer.value(socket, object.value(QStringLiteral("id")).toString());
+    const qint64 t1 = static_cast<qint64>(object.value(QStringLiteral("t1")).toDouble());
+    const qint64 t2 = static_cast<qint64>(object.value(QStringLiteral("t2")).toDouble());
+    const qint64 t3 = static_cast<qint64>(object.value(QStringLiteral("t3")).toDouble());
+    if (peerId.isEmpty() || t1 <= 0 || t2 <= 0 || t3 < t2 || now < t1) {
+        return;
+    }
+    ClockSample sample;
+    sample.rtt = qMax<qint64>(0, (now - t1) - (t3 - t2));
+    sample.offset = ((t2 - t1) + (t3 - now)) / 2;
+
+    ClockEstimate &clock = m_clocks[peerId];
+    clock.samples.append(sample);
+    while (clock.samples.size() > ClockSampleCount) {
+        clock.samples.removeFirst();
+    }
+    // 往返时延最小的样本受排队延迟影响最小，其偏差估计最可靠。
+    ClockSample best = clock.samples.constFirst();
+    for (const ClockSample &candidate : std::as_const(clock.samples)) {
+        if (candidate.rtt < best.rtt) {
+            best = candidate;
+        }
+    }
+
+    if (best.rtt != clock.rtt || best.offset != clock.offset) {
+        clock.rtt = best.rtt;
+        clock.offset = best.offset;
+        emit clockEstimateUpdated(peerId, clock.offset, clock.rtt);
+    }
 }
 
-void MessageRouter::sendJson(QTcpSocket *socket, const QJsonObject &object) {
+MessageRouter::PoolStats MessageRouter::poolStats() const {
+    PoolStats stats = m_poolStats;
+    stats.openSessions = m_peerSessions.size() + m_bulkSessions.size();
+    stats.pendingSessions = m_pendingSessions.size();
+    stats.capacity = m_maxSessions;
+    return stats;
+}
+
+bool MessageRouter::canSendBulk(const PeerInfo &peer, int stripe) const {
+    const Lane lane = laneFor(peer, Lane::Bulk);
+    stripe = lane == Lane::Bulk && canStripe(peer) ? qBound(0, stripe, MaxBulkStripes - 1) : 0;
+    if (QTcpSocket *socket = connectedSession(peer.id, lane, stripe)) {
+        const auto state = m_socketStates.constFind(socket);
+        return state == m_socketStates.constEnd() || !state->congested;
+    }
+    const auto pending = m_pendingSessions.constFind(sessionKey(peer.id, lane, stripe));
+    return pending == m_pendingSessions.constEnd() || !pending->congested;
+}
+
+void MessageRouter::handleNewConnection() {
+    while (m_server.hasPendingConnections()) {
+        QTcpSocket *socket = m_server.nextPendingConnection();
+        attachSocketSignals(socket);
+        applyLaneSocketOptions(socket, Lane::Interactive);
+    }
+}
+
+void MessageRouter::readSocket() {
+    auto *socket = qobject_cast<QTcpSocket *>(sender());
     if (!socket) {
         return;
     }
-    QByteArray payload = QJsonDocument(object).toJson(QJsonDocument::Compact);
-    payload.append('\n');
-    socket->write(payload);
+
+    {
+        SocketState &state = m_socketStates[socket];
+        const QByteArray data = socket->readAll();
+        state.bytesIn += static_cast<quint64>(data.size());
+        state.inRate.add(m_clock.elapsed(), static_cast<quint64>(data.size()));
+        state.decoder.append(data);
+        if (state.decoder.mode() == WireProtocol::FrameDecoder::Mode::Frames) {
+            // 对端以分帧协议发起会话时，回复也使用分帧协议。
+            state.framed = true;
+        }
+        if (state.drainScheduled) {
+            return;
+        }
+    }
+    drainSocket(socket);
 }
 
-void MessageRouter::cleanupSocket(QTcpSocket *socket) {
-    const QString peerId = m_socketToPeer.take(socket);
-    if (!peerId.isEmpty()) {
-        auto it = m_peerSessions.find(peerId);
-        if (it != m_peerSessions.end() && it.value() == socket) {
-            m_peerSessions.erase(it);
+void MessageRouter::drainSocket(QTcpSocket *socket) {
+    // 分发过程中上层可能新建会话导致哈希表重排，因此每轮重新查找状态而不持有引用。
+    WireProtocol::Frame frame;
+    int consumed = 0;
+    for (;;) {
+        auto it = m_socketStates.find(socket);
+        if (it == m_socketStates.end()) {
+            return;
+        }
+        it->drainScheduled = false;
+        if (isHeld(*it)) {
+            // 数据留在解码缓冲中，被淘汰的连接确认后由 releaseHeld 继续分发。
+            return;
+        }
+        if (it->lane == Lane::Bulk && consumed >= BulkDrainBudget) {
+            it->drainScheduled = true;
+            QPointer<QTcpSocket> guard(socket);
+            QMetaObject::invokeMethod(
+                this,
+                [this, guard]() {
+                    if (guard) {
+                        drainSocket(guard.data());
+                    }
+                },
+                Qt::QueuedConnection);
+            return;
         }
+        if (!it->decoder.next(&frame)) {
+            if (it->decoder.hasError()) {
+                emit routerWarning(
+                    tr("收到无法识别的数据帧，已断开与 %1 的连接").arg(socket->peerAddress().toString()));
+                socket->abort();
+            }
+            return;
+        }
+        consumed += frame.payload.size();
+        dispatchFrame(socket, std::move(frame));
     }
-    m_pendingBuffers.remove(socket);
 }
 
-void MessageRouter::stop() {
-    if (m_server.isListening()) {
-        m_server.close();
+void MessageRouter::dispatchFrame(QTcpSocket *socket, WireProtocol::Frame frame) {
+    qint64 previousActivity = 0;
+    {
+        auto state = m_socketStates.find(socket);
+        if (state != m_socketStates.end()) {
+            ++state->messagesIn;
+            previousActivity = state->lastActivity;
+            state->lastActivity = m_clock.elapsed();
+        }
+    }
+    if (!openSealedFrame(socket, &frame)) {
+        return;
+    }
+    QByteArray body = std::move(frame.payload);
+    if (frame.flags & WireProtocol::Compressed) {
+        QByteArray inflated;
+        if (!WireProtocol::decompressPayload(body, &inflated)) {
+            return;
+        }
+        body = inflated;
+        // 对端发来压缩帧说明其支持压缩，回复也启用压缩。
+        auto state = m_socketStates.find(socket);
+        if (state != m_socketStates.end()) {
+            state->compress = true;
+        }
+    }
+
+    if (frame.type == WireProtocol::FrameType::FileRegion) {
+        QString transferId;
+        quint64 offset = 0;
+        QByteArray data;
+        const QString peerId = m_socketToPeer.value(socket);
+        if (refusesPlaintext(socket, frame.flags, peerId)) {
+            return;
+        }
+        if (!peerId.isEmpty() && WireProtocol::decodeRegion(body, &transferId, &offset, &data)) {
+            emit fileChunkReceived(peerId, transferId, offset, data);
+        }
+        return;
+    }
+
+    QJsonObject obj;
+    QByteArray binary;
+    if (frame.type == WireProtocol::FrameType::Json) {
+        const QJsonDocument doc = QJsonDocument::fromJson(body);
+        if (!doc.isObject()) {
+            return;
+        }
+        obj = doc.object();
+    } else if (frame.type == WireProtocol::FrameType::Cbor) {
+        if (!MessageCodec::decodeCbor(body, &obj, &binary)) {
+            return;
+        }
+        // 对端以 CBOR 发来消息说明其支持该编码，回复也使用 CBOR。
+        auto state = m_socketStates.find(socket);
+        if (state != m_socketStates.end()) {
+            state->cbor = true;
+        }
+    } else {
+        return;
+    }
+
+    const QString type = obj.value(QStringLiteral("type")).toString();
+    if (type == QStringLiteral("seal_hello") || type == QStringLiteral("seal_accept") ||
+        type == QStringLiteral("seal_reject")) {
+        handleSealHandshake(socket, type, obj);
+        return;
+    }
+    const QString senderId = m_socketToPeer.value(socket, obj.value(QStringLiteral("id")).toString());
+    if (refusesPlaintext(socket, frame.flags, senderId)) {
+        return;
+    }
+    if (type == QStringLiteral("ping") || type == QStringLiteral("pong")) {
+        // 探测报文不算作会话活动，否则空闲会话永远不会被回收。
+        auto state = m_socketStates.find(socket);
+        if (state != m_socketStates.end()) {
+            state->lastActivity = previousActivity;
+        }
+        handleClockProbe(socket, type, obj);
+        return;
+    }
+    if (type == QStringLiteral("chat_ack") || type == QStringLiteral("file_ack") ||
+        type == QStringLiteral("file_cancel")) {
+        handleAckForStats(obj.value(QStringLiteral("id")).toString(), type, obj);
+    }
+    if (type == QStringLiteral("session_retire") || type == QStringLiteral("session_retire_ack")) {
+        handleRetire(socket, type);
+        return;
+    }
+    if (type == QStringLiteral("channel")) {
+        const QString peerId = obj.value(QStringLiteral("id")).toString();
+        auto state = m_socketStates.find(socket);
+        if (peerId.isEmpty() || state == m_socketStates.end() ||
+            obj.value(QStringLiteral("lane")).toString() != QStringLiteral("bulk")) {
+            return;
+        }
+        state->lane = Lane::Bulk;
+        state->stripe = qBound(0, obj.value(QStringLiteral("stripe")).toInt(), MaxBulkStripes - 1);
+        const int stripe = state->stripe;
+        applyLaneSocketOptions(socket, Lane::Bulk);
+        registerSession(socket, peerId, Lane::Bulk, stripe);
+        return;
+    }
+    if (type == QStringLiteral("file_chunk")) {
+        const QString peerId = obj.value(QStringLiteral("id")).toString();
+        if (!peerId.isEmpty()) {
+            m_socketToPeer.insert(socket, peerId);
+        }
+        if (frame.type == WireProtocol::FrameType::Json) {
+            binary = QByteArray::fromBase64(obj.value(QStringLiteral("data")).toString().toLatin1());
+        }
+        emit fileChunkReceived(peerId, obj.value(QStringLiteral("transferId")).toString(),
+                               static_cast<quint64>(obj.value(QStringLiteral("offset")).toDouble()), binary);
+        return;
+    }
+
+    PeerInfo peer;
+    peer.id = obj.value(QStringLiteral("id")).toString();
+    peer.displayName = obj.value(QStringLiteral("displayName")).toString();
+    peer.address = socket->peerAddress();
+    peer.listenPort = static_cast<quint16>(socket->peerPort());
+    peer.lastSeen = QDateTime::currentDateTimeUtc();
+    const auto known = m_knownPeers.constFind(peer.id);
+    if (known != m_knownPeers.constEnd()) {
+        // 入站连接的源端口是临时端口，回复与新建会话需使用对方广播的监听端口和能力。
+        peer.listenPort = known->listenPort;
+        peer.capabilities = known->capabilities;
+        peer.hostId = known->hostId;
+        peer.localEndpoint = known->localEndpoint;
+        if (peer.address.isNull()) {
+            // 同机连接的 Unix 域套接字没有 IP 地址，沿用对方广播的地址。
+            peer.address = known->address;
+        }
+    }
+    const auto state = m_socketStates.constFind(socket);
+    const bool interactive = state == m_socketStates.constEnd() || state->lane == Lane::Interactive;
+    if (!peer.id.isEmpty() && interactive) {
+        registerSession(socket, peer.id, Lane::Interactive);
+    }
+
+    emit messageReceived(peer, obj);
+}
+
+MessageRouter::Lane MessageRouter::laneFor(const PeerInfo &peer, Lane lane) {
+    return lane == Lane::Bulk && !peer.supports(PeerCapability::BulkLane) ? Lane::Interactive : lane;
+}
+
+QString MessageRouter::sessionKey(const QString &peerId, Lane lane, int stripe) {
+    if (lane != Lane::Bulk) {
+        return peerId;
+    }
+    return stripe > 0 ? peerId + QStringLiteral("#bulk") + QString::number(stripe) : peerId + QStringLiteral("#bulk");
+}
+
+QString MessageRouter::stripeKey(const QString &peerId, int stripe) {
+    return stripe > 0 ? peerId + QLatin1Char('#') + QString::number(stripe) : peerId;
+}
+
+QTcpSocket *MessageRouter::connectedSession(const QString &peerId, Lane lane, int stripe) const {
+    const QPointer<QTcpSocket> socket =
+        lane == Lane::Bulk ? m_bulkSessions.value(stripeKey(peerId, stripe)) : m_peerSessions.value(peerId);
+    if (socket.isNull() || socket->state() != QAbstractSocket::ConnectedState) {
+        return nullptr;
+    }
+    return socket.data();
+}
+
+bool MessageRouter::sendToPeer(const PeerInfo &peer, Lane lane, const QJsonObject &object,
+                               MessageClass messageClass, const QByteArray &binary, int stripe) {
+    PendingMessage message;
+    message.object = object;
+    message.binary = binary;
+    return sendToPeer(peer, lane, message, messageClass, stripe);
+}
+
+bool MessageRouter::sendToPeer(const PeerInfo &peer, Lane lane, const PendingMessage &message,
+                               MessageClass messageClass, int stripe) {
+    if (peer.id.isEmpty()) {
+        return false;
+    }
+    lane = laneFor(peer, lane);
+    // 对端不支持条带时所有数据都走第 0 条连接，保持原有的单连接顺序语义。
+    stripe = lane == Lane::Bulk && canStripe(peer) ? qBound(0, stripe, MaxBulkStripes - 1) : 0;
+    if (QTcpSocket *socket = connectedSession(peer.id, lane, stripe)) {
+        return sendMessage(socket, message, messageClass);
+    }
+
+    // 会话尚未建立：消息暂存在待连接队列中，连接成功后按序写出，入队策略与已连接时一致。
+    const QString key = sessionKey(peer.id, lane, stripe);
+    auto it = m_pendingSessions.find(key);
+    const bool created = it == m_pendingSessions.end();
+    if (created) {
+        it = m_pendingSessions.insert(key, PendingSession());
+        it->lane = lane;
+        it->stripe = stripe;
+    }
+    it->peer = peer;
+    if (messageClass == MessageClass::Bulk && it->congested) {
+        return false;
+    }
+    if (messageClass == MessageClass::Interactive && it->queuedBytes >= HardLimit) {
+        return false;
+    }
+    it->messages.enqueue(message);
+    it->queuedBytes += pendingSize(message);
+    const bool congested = !it->congested && it->queuedBytes >= HighWatermark;
+    if (congested) {
+        it->congested = true;
+    }
+
+    if (created) {
+        startConnecting(key);
+    }
+    if (congested) {
+        emit peerBackpressure(peer.id, true);
+    }
+    return true;
+}
+
+QList<QHostAddress> MessageRouter::candidateAddresses(const PeerInfo &peer) const {
+    QList<QHostAddress> addresses;
+    if (!peer.address.isNull()) {
+        addresses.append(peer.address);
+    }
+    const QList<QHostAddress> known = m_peerAddresses.value(peer.id);
+    for (const QHostAddress &address : known) {
+        if (!addresses.contains(address)) {
+            addresses.append(address);
+        }
+    }
+    // 按最近被发现的顺序取前几个地址并行连接，最先连通的即为当前最快的路径；
+    // 时延探测只覆盖已连通的那条地址，不足以给多宿主联系人的地址排序。
+    return addresses.mid(0, MaxParallelConnects);
+}
+
+void MessageRouter::startConnecting(const QString &key) {
+    auto it = m_pendingSessions.find(key);
+    if (it == m_pendingSessions.end()) {
+        return;
+    }
+    it->state = PendingState::Connecting;
+    const quint64 generation = ++it->generation;
+    const PeerInfo peer = it->peer;
+    const Lane lane = it->lane;
+    const int stripe = it->stripe;
+
+    if (isSameHost(peer)) {
+        if (QTcpSocket *socket = connectLocal(peer, lane, stripe)) {
+            // 同机连接已同步建立，排队处理以免在调用方持有待连接会话时重入。
+            it->attempts = {QPointer<QTcpSocket>(socket)};
+            QPointer<QTcpSocket> guard(socket);
+            QMetaObject::invokeMethod(
+                this,
+                [this, key, guard]() {
+                    if (guard) {
+                        handleAttemptConnected(key, guard.data());
+                    } else {
+                        handleConnectFailure(key);
+                    }
+                },
+                Qt::QueuedConnection);
+            return;
+        }
+    }
+
+    // 对端有多个已知地址时并行发起连接，最先建立的连接胜出，其余连接随即放弃。
+    const QList<QHostAddress> addresses = candidateAddresses(peer);
+    QList<QPointer<QTcpSocket>> attempts;
+    for (int i = 0; i < addresses.size(); ++i) {
+        auto *socket = new QTcpSocket(this);
+        attachSocketSignals(socket);
+        SocketState &state = m_socketStates[socket];
+        state.framed = lane == Lane::Bulk || peer.supports(PeerCapability::Framing);
+        state.cbor = state.framed && peer.supports(PeerCapability::CborEncoding);
+        state.compress = state.framed && peer.supports(PeerCapability::Compression);
+        state.lane = lane;
+        state.stripe = stripe;
+        state.initiatedLocally = true;
+        connect(socket, &QTcpSocket::connected, this, [this, key, socket]() { handleAttemptConnected(key, socket); });
+        connect(socket, &QAbstractSocket::errorOccurred, this,
+                [this, key, socket]() { handleAttemptFailed(key, socket); });
+        attempts.append(socket);
+    }
+    it->attempts = attempts;
+    if (attempts.isEmpty()) {
+        handleConnectFailure(key);
+        return;
+    }
+
+    QTimer::singleShot(ConnectTimeoutMs, this, [this, key, generation]() {
+        const auto pending = m_pendingSessions.constFind(key);
+        if (pending != m_pendingSessions.constEnd() && pending->generation == generation &&
+            pending->state == PendingState::Connecting) {
+            handleConnectFailure(key);
+        }
+    });
+    for (int i = 0; i < attempts.size(); ++i) {
+        // 连接失败可能同步上报并触发退避，此时剩余尝试已被放弃。
+        const auto pending = m_pendingSessions.constFind(key);
+        if (pending == m_pendingSessions.constEnd() || pending->generation != generation) {
+            break;
+        }
+        if (attempts.at(i)) {
+            attempts.at(i)->connectToHost(addresses.at(i), peer.listenPort);
+        }
+    }
+}
+
+void MessageRouter::handleAttemptConnected(const QString &key, QTcpSocket *socket) {
+    if (!m_pendingSessions.contains(key)) {
+        discardAttempt(socket);
+        return;
+    }
+    PendingSession session = m_pendingSessions.take(key);
+    for (const QPointer<QTcpSocket> &attempt : std::as_const(session.attempts)) {
+        if (attempt && attempt.data() != socket) {
+            discardAttempt(attempt.data());
+        }
+    }
+
+    const QString peerId = session.peer.id;
+    if (canSeal(session.peer)) {
+        // 先发起加密握手，随后的通道声明与暂存消息在握手完成前留在发送队列中。
+        beginSeal(socket, peerId);
+    }
+    registerSession(socket, peerId, session.lane, session.stripe);
+    QTcpSocket *active = connectedSession(peerId, session.lane, session.stripe);
+    if (!active) {
+        return;
+    }
+    if (active == socket && session.lane == Lane::Bulk) {
+        // 批量通道是独立的 TCP 连接，首帧声明通道类型（及条带序号），文件数据不会阻塞交互通道上的聊天消息。
+        QJsonObject hello{
+            {QStringLiteral("type"), QStringLiteral("channel")},
+            {QStringLiteral("id"), m_localPeerId},
+            {QStringLiteral("lane"), QStringLiteral("bulk")}
+        };
+        if (session.stripe > 0) {
+            hello.insert(QStringLiteral("stripe"), session.stripe);
+        }
+        sendMessage(socket, hello, MessageClass::Control);
+    }
+    // 暂存的消息入队时已按策略放行，此处按控制消息写出，不再二次丢弃。
+    while (!session.messages.isEmpty()) {
+        const PendingMessage message = session.messages.dequeue();
+        sendMessage(active, message, MessageClass::Control);
+    }
+    const auto state = m_socketStates.constFind(active);
+    if (session.congested && (state == m_socketStates.constEnd() || !state->congested)) {
+        emit peerBackpressure(peerId, false);
+    }
+}
+
+void MessageRouter::handleAttemptFailed(const QString &key, QTcpSocket *socket) {
+    auto it = m_pendingSessions.find(key);
+    if (it == m_pendingSessions.end() || !it->attempts.contains(QPointer<QTcpSocket>(socket))) {
+        return;
+    }
+    it->attempts.removeAll(QPointer<QTcpSocket>(socket));
+    it->attempts.removeAll(QPointer<QTcpSocket>());
+    const bool exhausted = it->state == PendingState::Connecting && it->attempts.isEmpty();
+    discardAttempt(socket);
+    if (exhausted) {
+        handleConnectFailure(key);
+    }
+}
+
+void MessageRouter::handleConnectFailure(const QString &key) {
+    auto it = m_pendingSessions.find(key);
+    if (it == m_pendingSessions.end()) {
+        return;
+    }
+    const QList<QPointer<QTcpSocket>> attempts = it->attempts;
+    it->attempts.clear();
+    it->state = PendingState::Backoff;
+    ++it->failures;
+    const int failures = it->failures;
+    const quint64 generation = ++it->generation;
+    for (const QPointer<QTcpSocket> &attempt : attempts) {
+        if (attempt) {
+            discardAttempt(attempt.data());
+        }
+    }
+
+    // 已离线的联系人不再退避重连，待其重新上线时由 setPeerAlive 恢复。
+    if (failures >= MaxConnectFailures || m_offlinePeers.contains(it->peer.id)) {
+        abandonPendingSession(key);
+        return;
+    }
+
+    // 指数退避并叠加 ±50% 随机抖动，避免大量客户端在对端恢复时同时重连。
+    const int base = qMin(BackoffBaseMs << (failures - 1), BackoffMaxMs);
+    const int delay = base / 2 + static_cast<int>(QRandomGenerator::global()->bounded(base));
+    QTimer::singleShot(delay, this, [this, key, generation]() {
+        const auto pending = m_pendingSessions.constFind(key);
+        if (pending != m_pendingSessions.constEnd() && pending->generation == generation) {
+            startConnecting(key);
+        }
+    });
+}
+
+void MessageRouter::abandonPendingSession(const QString &key) {
+    const PendingSession session = m_pendingSessions.take(key);
+    if (!session.messages.isEmpty()) {
+        emit routerWarning(
+            tr("无法与 %1 建立会话，%2 条消息未能发送").arg(session.peer.displayName).arg(session.messages.size()));
+    }
+    if (session.congested) {
+        emit peerBackpressure(session.peer.id, false);
+    }
+    if (session.lane == Lane::Bulk) {
+        emit stripeClosed(session.peer.id, session.stripe);
+    } else {
+        emit sessionClosed(session.peer.id);
+    }
+}
+
+void MessageRouter::setPeerAlive(const QString &peerId, bool alive) {
+    if (alive ? m_offlinePeers.remove(peerId) == 0 : m_offlinePeers.contains(peerId)) {
+        return;
+    }
+    if (!alive) {
+        m_offlinePeers.insert(peerId);
+    }
+    QStringList backoff;
+    for (auto it = m_pendingSessions.cbegin(); it != m_pendingSessions.cend(); ++it) {
+        if (it->peer.id == peerId && it->state == PendingState::Backoff) {
+            backoff.append(it.key());
+        }
+    }
+    for (const QString &key : std::as_const(backoff)) {
+        if (alive) {
+            // 联系人重新上线，不必等完剩余的退避时间。
+            m_pendingSessions[key].failures = 0;
+            startConnecting(key);
+        } else {
+            abandonPendingSession(key);
+        }
+    }
+}
+
+void MessageRouter::registerSession(QTcpSocket *socket, const QString &peerId, Lane lane, int stripe) {
+    m_socketToPeer.insert(socket, peerId);
+    const auto state = m_socketStates.constFind(socket);
+    if (state != m_socketStates.constEnd() && state->retiring) {
+        return;
+    }
+    auto &sessions = lane == Lane::Bulk ? m_bulkSessions : m_peerSessions;
+    const QString key = lane == Lane::Bulk ? stripeKey(peerId, stripe) : peerId;
+    const QPointer<QTcpSocket> existing = sessions.value(key);
+    if (existing.isNull() || existing->state() != QAbstractSocket::ConnectedState) {
+        sessions.insert(key, socket);
+        if (state != m_socketStates.constEnd()) {
+            m_socketStates[socket].connectedAt = m_clock.elapsed();
+        }
+        if (lane == Lane::Interactive && m_knownPeers.value(peerId).supports(PeerCapability::ClockSync)) {
+            // 新会话建立后尽快测一次时延与时钟偏差，之后由定时器周期性探测。
+            QPointer<QTcpSocket> guard(socket);
+            QTimer::singleShot(0, this, [this, guard]() {
+                if (guard) {
+                    sendProbe(guard.data(), QJsonObject{{QStringLiteral("type"), QStringLiteral("ping")}});
+                }
+            });
+        }
+        // 同一会话键再次建立即为一次重连，用于诊断连接不稳定的联系人。
+        PeerCounters &counters = m_peerCounters[peerId];
+        const QString sessionId = lane == Lane::Bulk ? sessionKey(peerId, lane, stripe) : peerId;
+        if (counters.openedSessions.contains(sessionId)) {
+            ++counters.reconnects;
+        } else {
+            counters.openedSessions.insert(sessionId);
+        }
+        enforcePoolLimit(socket);
+        return;
+    }
+    if (existing.data() == socket) {
+        return;
+    }
+
+    // 双方同时发起连接时会出现两条会话。约定保留 ID 较小一方发起的连接，两端各自判断结果一致；
+    // 同一方向的重复连接（如对端重启后重连）则保留较新的连接。
+    const auto existingState = m_socketStates.constFind(existing.data());
+    const bool socketLocal = state != m_socketStates.constEnd() && state->initiatedLocally;
+    const bool existingLocal = existingState != m_socketStates.constEnd() && existingState->initiatedLocally;
+    bool keepNew = true;
+    if (socketLocal != existingLocal) {
+        const bool keepLocal = m_localPeerId < peerId;
+        keepNew = socketLocal == keepLocal;
+    }
+    QTcpSocket *winner = keepNew ? socket : existing.data();
+    QTcpSocket *loser = keepNew ? existing.data() : socket;
+    sessions.insert(key, winner);
+    retireSocket(loser, winner);
+}
+
+void MessageRouter::retireSocket(QTcpSocket *loser, QTcpSocket *winner, bool acknowledge) {
+    auto loserState = m_socketStates.find(loser);
+    if (loserState == m_socketStates.end()) {
+        loser->disconnectFromHost();
+        return;
+    }
+    // 被淘汰的连接不再接收新消息，但继续读取并分发对端已发出的数据；
+    // 发起方发送 session_retire，对端把剩余数据写完后回复 session_retire_ack，发起方收到确认后才关闭。
+    const bool wasRetiring = loserState->retiring;
+    loserState->retiring = true;
+    if (!wasRetiring) {
+        loserState->retiringSince = m_clock.elapsed();
+    }
+    const bool wasCongested = loserState->congested;
+    bool winnerCongested = true;
+    // 已在退役中的连接队列里只剩控制帧（如本端的 session_retire），不再移交。
+    const bool handOver = winner && winner != loser && !wasRetiring;
+    if (handOver) {
+        // 尚未写出的消息移交给保留的连接，按其编码格式重新序列化，不丢失任何数据。
+        QQueue<PendingMessage> moved;
+        moved.swap(loserState->outbound);
+        const qint64 movedBytes = loserState->queuedBytes;
+        loserState->queuedBytes = 0;
+        loserState->congested = false;
+
+        auto winnerState = m_socketStates.find(winner);
+        if (winnerState == m_socketStates.end()) {
+            winnerState = m_socketStates.insert(winner, SocketState());
+        }
+        while (!moved.isEmpty()) {
+            winnerState->outbound.enqueue(moved.dequeue());
+        }
+        winnerState->queuedBytes += movedBytes;
+        winnerCongested = winnerState->congested;
+        if (!acknowledge) {
+            // 两条连接上的数据由对端分别读取：本端先写在被淘汰连接上的消息可能晚于保留连接上的后续消息到达。
+            // 对端的确认是它在被淘汰连接上的最后一帧，收到前保留的连接暂停收发，两个方向都按原顺序交付。
+            winnerState->heldFor = loser;
+        }
+    }
+
+    const QJsonObject control{
+        {QStringLiteral("type"), acknowledge ? QStringLiteral("session_retire_ack") : QStringLiteral("session_retire")},
+        {QStringLiteral("id"), m_localPeerId}};
+    sendMessage(loser, control, MessageClass::Control);
+    if (!wasRetiring) {
+        scheduleRetireCheck(loser);
+    }
+    if (handOver) {
+        flushOutbound(winner);
+        if (wasCongested && !winnerCongested) {
+            const auto updated = m_socketStates.constFind(winner);
+            if (updated == m_socketStates.constEnd() || !updated->congested) {
+                emit peerBackpressure(m_socketToPeer.value(winner), false);
+            }
+        }
+    }
+}
+
+void MessageRouter::handleRetire(QTcpSocket *socket, const QString &type) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end()) {
+        return;
+    }
+    if (type == QStringLiteral("session_retire_ack")) {
+        if (!state->retiring) {
+            return;
+        }
+        // 确认是对端在该连接上发出的最后一帧，之前的数据均已分发；推迟到下一轮事件循环关闭，
+        // 避免 disconnected 同步触发清理时打断正在进行的解码循环。
+        releaseHeld(socket);
+        closeRetired(socket);
+        return;
+    }
+    // 对端决定淘汰该连接：若它仍登记为会话则移出，待发送消息转交同一会话键下的其他连接（没有则留在本连接写完）。
+    const QString peerId = m_socketToPeer.value(socket);
+    const bool bulk = state->lane == Lane::Bulk;
+    auto &sessions = bulk ? m_bulkSessions : m_peerSessions;
+    const QString key = bulk ? stripeKey(peerId, state->stripe) : peerId;
+    QTcpSocket *winner = nullptr;
+    const auto current = sessions.find(key);
+    if (current != sessions.end()) {
+        if (current.value().data() == socket) {
+            sessions.erase(current);
+        } else if (current.value() && current.value()->state() == QAbstractSocket::ConnectedState) {
+            winner = current.value().data();
+        }
+    }
+    retireSocket(socket, winner, true);
+}
+
+void MessageRouter::scheduleRetireCheck(QTcpSocket *socket) {
+    QPointer<QTcpSocket> guard(socket);
+    QTimer::singleShot(RetireQuietMs, this, [this, guard]() {
+        if (!guard) {
+            return;
+        }
+        const auto state = m_socketStates.constFind(guard.data());
+        if (state == m_socketStates.constEnd() || !state->retiring) {
+            return;
+        }
+        // 不认识 session_retire 的旧版本对端不会回复确认：双向静默足够久、本端数据也已写完时同样视为可以关闭。
+        const qint64 now = m_clock.elapsed();
+        const bool drained = state->outbound.isEmpty() && !state->rawActive && guard->bytesToWrite() == 0;
+        if ((drained && now - state->lastActivity >= RetireQuietMs) || now - state->retiringSince >= RetireTimeoutMs) {
+            closeRetired(guard.data());
+            return;
+        }
+        scheduleRetireCheck(guard.data());
+    });
+}
+
+void MessageRouter::closeRetired(QTcpSocket *socket) {
+    QPointer<QTcpSocket> guard(socket);
+    QMetaObject::invokeMethod(
+        this,
+        [guard]() {
+            if (guard) {
+                guard->disconnectFromHost();
+            }
+        },
+        Qt::QueuedConnection);
+}
+
+bool MessageRouter::isHeld(const SocketState &state) const {
+    if (state.heldFor.isNull()) {
+        return false;
+    }
+    const auto loser = m_socketStates.constFind(state.heldFor.data());
+    return loser != m_socketStates.constEnd() && loser->retiring;
+}
+
+void MessageRouter::releaseHeld(QTcpSocket *loser) {
+    QList<QTcpSocket *> released;
+    for (auto it = m_socketStates.begin(); it != m_socketStates.end(); ++it) {
+        if (it->heldFor.data() == loser) {
+            it->heldFor.clear();
+            released.append(it.key());
+        }
+    }
+    // 排到下一轮事件循环恢复收发，避免在分发或清理过程中重入。
+    for (QTcpSocket *socket : std::as_const(released)) {
+        QPointer<QTcpSocket> guard(socket);
+        scheduleFlush(socket);
+        QMetaObject::invokeMethod(
+            this,
+            [this, guard]() {
+                if (guard) {
+                    drainSocket(guard.data());
+                }
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+bool MessageRouter::isIdle(QTcpSocket *socket, const SocketState &state) const {
+    return !state.retiring && state.outbound.isEmpty() && !state.rawActive && socket->bytesToWrite() == 0 &&
+           socket->state() == QAbstractSocket::ConnectedState;
+}
+
+void MessageRouter::enforcePoolLimit(QTcpSocket *keep) {
+    // 连接池容量有限（默认数百），超限时线性扫描找出最久未活动的空闲会话即可，无需额外维护 LRU 链表。
+    int open = m_peerSessions.size() + m_bulkSessions.size();
+    while (open > m_maxSessions) {
+        QTcpSocket *victim = nullptr;
+        qint64 oldest = 0;
+        const auto collect = [&](const QHash<QString, QPointer<QTcpSocket>> &sessions) {
+            for (const QPointer<QTcpSocket> &socket : sessions) {
+                if (socket.isNull() || socket.data() == keep) {
+                    continue;
+                }
+                const auto state = m_socketStates.constFind(socket.data());
+                if (state == m_socketStates.constEnd() || !isIdle(socket.data(), *state)) {
+                    continue;
+                }
+                if (!victim || state->lastActivity < oldest) {
+                    victim = socket.data();
+                    oldest = state->lastActivity;
+                }
+            }
+        };
+        collect(m_peerSessions);
+        collect(m_bulkSessions);
+        if (!victim) {
+            return;
+        }
+        ++m_poolStats.evictions;
+        releaseSession(victim);
+        open = m_peerSessions.size() + m_bulkSessions.size();
+    }
+}
+
+void MessageRouter::reapIdleSessions() {
+    const qint64 now = m_clock.elapsed();
+    QList<QTcpSocket *> expired;
+    for (auto it = m_socketStates.cbegin(); it != m_socketStates.cend(); ++it) {
+        if (isIdle(it.key(), it.value()) && now - it->lastActivity >= m_idleTimeoutMs) {
+            expired.append(it.key());
+        }
+    }
+    for (QTcpSocket *socket : std::as_const(expired)) {
+        ++m_poolStats.idleClosures;
+        releaseSession(socket);
+    }
+}
+
+void MessageRouter::releaseSession(QTcpSocket *socket) {
+    // 主动回收的会话先移出会话表，不通知上层：它没有在途数据，下次发送时重新建立。
+    // 关闭走与重复连接相同的退役握手，对端据此同样静默地移除该会话，而不是当作断线处理。
+    const auto state = m_socketStates.constFind(socket);
+    if (state != m_socketStates.constEnd()) {
+        const QString peerId = m_socketToPeer.value(socket);
+        const bool bulk = state->lane == Lane::Bulk;
+        auto &sessions = bulk ? m_bulkSessions : m_peerSessions;
+        const auto it = sessions.find(bulk ? stripeKey(peerId, state->stripe) : peerId);
+        if (it != sessions.end() && it.value() == socket) {
+            sessions.erase(it);
+        }
+    }
+    retireSocket(socket, nullptr);
+}
+
+void MessageRouter::discardAttempt(QTcpSocket *socket) {
+    socket->disconnect(this);
+    cleanupSocket(socket);
+    socket->abort();
+    socket->deleteLater();
+}
+
+qint64 MessageRouter::pendingSize(const PendingMessage &message) {
+    // 粗略估计编码后的大小：固定字段开销加上二进制内容、文件区段及内联 data 字段。
+    return 256 + message.binary.size() + message.fileLength +
+           message.object.value(QStringLiteral("data")).toString().size();
+}
+
+void MessageRouter::attachSocketSignals(QTcpSocket *socket) {
+    connect(socket, &QTcpSocket::readyRead, this, &MessageRouter::readSocket);
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() {
+        ++m_writeStats.flushes;
+        flushOutbound(socket);
+    });
+    connect(socket, &QTcpSocket::connected, this, [this, socket]() {
+        // Qt 5 在连接建立前会忽略套接字选项，因此在 connected 时按通道设置。
+        const auto state = m_socketStates.constFind(socket);
+        applyLaneSocketOptions(socket, state == m_socketStates.constEnd() ? Lane::Interactive : state->lane);
+    });
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+        cleanupSocket(socket);
+        socket->deleteLater();
+    });
+}
+
+bool MessageRouter::sendMessage(QTcpSocket *socket, const QJsonObject &object, MessageClass messageClass,
+                                const QByteArray &binary) {
+    PendingMessage message;
+    message.object = object;
+    message.binary = binary;
+    return sendMessage(socket, message, messageClass);
+}
+
+bool MessageRouter::sendMessage(QTcpSocket *socket, const PendingMessage &message, MessageClass messageClass) {
+    if (!socket) {
+        return false;
+    }
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end()) {
+        state = m_socketStates.insert(socket, SocketState());
+    }
+
+    const qint64 pending = state->queuedBytes + socket->bytesToWrite();
+    if (messageClass == MessageClass::Bulk && state->congested) {
+        return false;
+    }
+    if (messageClass == MessageClass::Interactive && pending >= HardLimit) {
+        return false;
+    }
+
+    state->lastActivity = m_clock.elapsed();
+    state->queuedBytes += pendingSize(message);
+    state->outbound.enqueue(message);
+    ++m_writeStats.messages;
+    if (m_writeBatching) {
+        scheduleFlush(socket);
+        updateBackpressure(socket);
+    } else {
+        flushOutbound(socket);
+    }
+    return true;
+}
+
+QByteArray MessageRouter::encodeMessage(SocketState &state, const PendingMessage &message) {
+    if (message.file) {
+        // 加密会话无法零拷贝发送：读出文件区段，与子头一起组成普通的 FileRegion 帧后加密写出。
+        QByteArray payload = WireProtocol::encodeRegionHeader(message.object.value(QStringLiteral("transferId")).toString(),
+                                                              static_cast<quint64>(message.fileOffset),
+                                                              static_cast<quint32>(message.fileLength))
+                                 .mid(WireProtocol::HeaderSize);
+        if (!message.file->seek(message.fileOffset)) {
+            return {};
+        }
+        const QByteArray data = message.file->read(message.fileLength);
+        if (data.size() != message.fileLength) {
+            return {};
+        }
+        payload.append(data);
+        return encodeFrame(state, WireProtocol::FrameType::FileRegion, payload);
+    }
+    if (state.cbor) {
+        return encodeFrame(state, WireProtocol::FrameType::Cbor, MessageCodec::encodeCbor(message.object, message.binary));
+    }
+    QByteArray payload = QJsonDocument(withBinary(message.object, message.binary)).toJson(QJsonDocument::Compact);
+    if (state.framed) {
+        return encodeFrame(state, WireProtocol::FrameType::Json, payload);
+    }
+    payload.append('\n');
+    return payload;
+}
+
+QByteArray MessageRouter::encodeFrame(SocketState &state, WireProtocol::FrameType type, const QByteArray &body) {
+    QByteArray compressed;
+    quint16 flags = WireProtocol::NoFlags;
+    const QByteArray *payload = &body;
+    if (state.compress && WireProtocol::compressPayload(body, &compressed)) {
+        ++m_writeStats.compressedFrames;
+        m_writeStats.compressionSavedBytes += static_cast<quint64>(body.size() - compressed.size());
+        flags |= WireProtocol::Compressed;
+        payload = &compressed;
+    }
+    if (!state.sealed) {
+        return WireProtocol::encodeFrame(type, flags, *payload);
+    }
+    // 在帧缓冲区内原地加密负载，帧头作为附加认证数据，认证标签写入帧末预留的位置。
+    flags |= WireProtocol::Sealed;
+    QByteArray frame = WireProtocol::encodeFrame(type, flags, *payload, SessionCrypto::TagSize);
+    char *data = frame.data() + WireProtocol::HeaderSize;
+    const int length = payload->size();
+    if (!state.sendCipher.seal(data, length, frame.constData(), WireProtocol::HeaderSize, data + length)) {
+        return {};
+    }
+    return frame;
+}
+
+void MessageRouter::scheduleFlush(QTcpSocket *socket) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end() || state->flushScheduled) {
+        return;
+    }
+    state->flushScheduled = true;
+    QPointer<QTcpSocket> guard(socket);
+    QMetaObject::invokeMethod(
+        this,
+        [this, guard]() {
+            if (guard) {
+                flushOutbound(guard.data());
+            }
+        },
+        Qt::QueuedConnection);
+}
+
+void MessageRouter::applyLaneSocketOptions(QTcpSocket *socket, Lane lane) {
+    const auto state = m_socketStates.constFind(socket);
+    if (state != m_socketStates.constEnd() && state->local) {
+#ifdef Q_OS_LINUX
+        if (lane == Lane::Bulk) {
+            const int size = LocalBulkBufferSize;
+            ::setsockopt(static_cast<int>(socket->socketDescriptor()), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+            ::setsockopt(static_cast<int>(socket->socketDescriptor()), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+#endif
+        return;
+    }
+    // 交互通道关闭 Nagle 算法降低聊天与控制消息的延迟；批量通道保持默认以提高吞吐。
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, lane == Lane::Interactive ? 1 : 0);
+    socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+}
+
+void MessageRouter::flushOutbound(QTcpSocket *socket) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end()) {
+        return;
+    }
+    state->flushScheduled = false;
+    if (state->rawActive || state->sealing || isHeld(*state)) {
+        // 零拷贝写出尚未完成，期间不能经 QTcpSocket 写入其他数据，以免帧内容交错；加密握手完成前、
+        // 被淘汰的连接确认前同样暂停写出。
+        return;
+    }
+    // 只在套接字缓冲低于上限时补充数据，写出进度由 bytesWritten 驱动；排队的多条消息合并为一次写入。
+    QByteArray batch;
+    while (!state->outbound.isEmpty() && socket->bytesToWrite() + batch.size() < SocketBufferLimit) {
+        if (state->outbound.head().file && !state->sealed) {
+            // 文件区段需在 QTcpSocket 缓冲清空后直接写入套接字描述符。
+            if (!batch.isEmpty()) {
+                break;
+            }
+            socket->flush();
+            if (socket->bytesToWrite() > 0) {
+                break;
+            }
+            const PendingMessage message = state->outbound.dequeue();
+            state->queuedBytes -= pendingSize(message);
+            startRawSend(socket, message);
+            state = m_socketStates.find(socket);
+            if (state == m_socketStates.end()) {
+                return;
+            }
+            if (state->rawActive) {
+                updateBackpressure(socket);
+                return;
+            }
+            continue;
+        }
+        const PendingMessage message = state->outbound.dequeue();
+        state->queuedBytes -= pendingSize(message);
+        ++state->messagesOut;
+        const QByteArray payload = encodeMessage(*state, message);
+        if (payload.isEmpty()) {
+            emit routerWarning(tr("消息编码失败，已断开与 %1 的连接").arg(socket->peerAddress().toString()));
+            socket->abort();
+            return;
+        }
+        if (batch.isEmpty()) {
+            batch = payload;
+        } else {
+            batch.append(payload);
+        }
+    }
+    if (!batch.isEmpty()) {
+        socket->write(batch);
+        ++m_writeStats.bufferWrites;
+        countBytesOut(*state, static_cast<quint64>(batch.size()));
+    }
+    updateBackpressure(socket);
+}
+
+void MessageRouter::startRawSend(QTcpSocket *socket, const PendingMessage &message) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end()) {
+        return;
+    }
+    RawSend &raw = state->raw;
+    raw.header = WireProtocol::encodeRegionHeader(message.object.value(QStringLiteral("transferId")).toString(),
+                                                  static_cast<quint64>(message.fileOffset),
+                                                  static_cast<quint32>(message.fileLength));
+    raw.headerSent = 0;
+    raw.file = message.file;
+    raw.offset = message.fileOffset;
+    raw.remaining = message.fileLength;
+    state->rawActive = true;
+    ++state->messagesOut;
+    ++m_writeStats.bufferWrites;
+    pumpRawSend(socket);
+}
+
+bool MessageRouter::pumpRawSend(QTcpSocket *socket) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end() || !state->rawActive) {
+        return false;
+    }
+#ifdef Q_OS_LINUX
+    const int fd = static_cast<int>(socket->socketDescriptor());
+    bool blocked = false;
+    bool failed = fd < 0;
+    RawSend &raw = state->raw;
+    while (!blocked && !failed && raw.headerSent < raw.header.size()) {
+        const ssize_t sent = ::send(fd, raw.header.constData() + raw.headerSent,
+                                    static_cast<size_t>(raw.header.size() - raw.headerSent), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent >= 0) {
+            raw.headerSent += static_cast<int>(sent);
+            countBytesOut(*state, static_cast<quint64>(sent));
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            blocked = true;
+        } else if (errno != EINTR) {
+            failed = true;
+        }
+    }
+    while (!blocked && !failed && raw.remaining > 0) {
+        off_t offset = static_cast<off_t>(raw.offset);
+        const ssize_t sent = ::sendfile(fd, raw.file->handle(), &offset,
+                                        static_cast<size_t>(qMin(raw.remaining, SendfileStep)));
+        if (sent > 0) {
+            raw.offset = static_cast<qint64>(offset);
+            raw.remaining -= sent;
+            countBytesOut(*state, static_cast<quint64>(sent));
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            blocked = true;
+        } else if (sent == 0 || errno != EINTR) {
+            // 返回 0 表示文件在发送过程中被截断，帧已无法补齐。
+            failed = true;
+        }
+    }
+    if (failed) {
+        emit routerWarning(tr("文件数据发送失败，已断开与 %1 的连接").arg(socket->peerAddress().toString()));
+        socket->abort();
+        return false;
+    }
+    if (blocked) {
+        // 套接字发送缓冲已满，等待可写通知后继续；此时 QTcpSocket 自身的写通知处于关闭状态，不会冲突。
+        if (!state->writeNotifier) {
+            state->writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+            connect(state->writeNotifier, &QSocketNotifier::activated, this, [this, socket]() {
+                if (pumpRawSend(socket)) {
+                    flushOutbound(socket);
+                }
+            });
+        }
+        state->writeNotifier->setEnabled(true);
+        return false;
+    }
+    if (state->writeNotifier) {
+        state->writeNotifier->setEnabled(false);
+    }
+#endif
+    state->rawActive = false;
+    state->raw = RawSend();
+    return true;
+}
+
+void MessageRouter::updateBackpressure(QTcpSocket *socket) {
+    auto state = m_socketStates.find(socket);
+    if (state == m_socketStates.end()) {
+        return;
+    }
+    const qint64 pending = state->queuedBytes + socket->bytesToWrite();
+    bool changed = false;
+    if (!state->congested && pending >= HighWatermark) {
+        state->congested = true;
+        changed = true;
+    } else if (state->congested && pending <= LowWatermark) {
+        state->congested = false;
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+    const bool congested = state->congested;
+    const QString peerId = m_socketToPeer.value(socket);
+    if (!peerId.isEmpty()) {
+        emit peerBackpressure(peerId, congested);
+    }
+}
+
+void MessageRouter::cleanupSocket(QTcpSocket *socket) {
+    releaseHeld(socket);
+    const QString peerId = m_socketToPeer.take(socket);
+    const auto state = m_socketStates.constFind(socket);
+    const bool bulk = state != m_socketStates.constEnd() && state->lane == Lane::Bulk;
+    const int stripe = bulk ? state->stripe : 0;
+    const bool congested = state != m_socketStates.constEnd() && state->congested;
+    if (state != m_socketStates.constEnd() && state->writeNotifier) {
+        state->writeNotifier->setEnabled(false);
+        state->writeNotifier->deleteLater();
+    }
+    m_socketStates.remove(socket);
+    if (peerId.isEmpty()) {
+        return;
+    }
+    if (congested) {
+        emit peerBackpressure(peerId, false);
+    }
+
+    auto &sessions = bulk ? m_bulkSessions : m_peerSessions;
+    auto it = sessions.find(bulk ? stripeKey(peerId, stripe) : peerId);
+    if (it != sessions.end() && it.value() == socket) {
+        sessions.erase(it);
+        if (bulk) {
+            emit stripeClosed(peerId, stripe);
+        } else {
+            emit sessionClosed(peerId);
+        }
+    }
+}
+
+void MessageRouter::stop() {
+    // 定时器与写通知器都属于网络线程，须在此处停止，不能留给其他线程析构时处理。
+    m_idleTimer.stop();
+    m_probeTimer.stop();
+    if (m_server.isListening()) {
+        m_server.close();
+    }
+    closeLocalListener();
+    const QList<PendingSession> pending = m_pendingSessions.values();
+    m_pendingSessions.clear();
+    for (const PendingSession &session : pending) {
+        for (const QPointer<QTcpSocket> &attempt : session.attempts) {
+            if (attempt) {
+                discardAttempt(attempt.data());
+            }
+        }
     }
-    const auto sockets = m_peerSessions.values();
-    for (QTcpSocket *socket : sockets) {
-        if (socket) {
+    // 退役中的连接不在会话表中，按套接字状态表一并关闭。
+    for (auto it = m_socketStates.begin(); it != m_socketStates.end(); ++it) {
+        delete it->writeNotifier;
+        it->writeNotifier = nullptr;
+        if (QTcpSocket *socket = it.key()) {
+            disconnect(socket, nullptr, this, nullptr);
             socket->disconnectFromHost();
             socket->deleteLater();
         }
     }
     m_peerSessions.clear();
+    m_bulkSessions.clear();
     m_socketToPeer.clear();
-    m_pendingBuffers.clear();
+    m_socketStates.clear();
 }
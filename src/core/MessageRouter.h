@@ -1,46 +1,443 @@
 #pragma once
 
 #include "PeerInfo.h"
+#include "SessionCrypto.h"
+#include "WireProtocol.h"
 
 #include <QHash>
+#include <QList>
+#include <QMap>
 #include <QObject>
 #include <QPointer>
 #include <QJsonObject>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QSocketNotifier>
 #include <QTcpServer>
+#include <QTimer>
 #include <QTcpSocket>
+#include <QVector>
 
+#include <array>
+
+/*!
+ * \brief MessageRouter 管理与联系人之间的 TCP 会话，负责消息的分帧、编码与收发。
+ *
+ * 路由对象及其全部套接字归属同一个网络线程，其他线程需通过排队调用访问，
+ * 对外信号只携带解码完成的消息。
+ */
 class MessageRouter : public QObject {
     Q_OBJECT
 
 public:
+    /*!
+     * \brief 发送统计。
+     *
+     * bufferWrites 是交给 QTcpSocket 缓冲的写入调用次数（含 sendfile 区段），与入队消息数之差即合并写出
+     * 省下的写入调用；flushes 是套接字缓冲实际写入内核的次数（bytesWritten 事件数），更接近真实的系统调用数。
+     */
+    struct WriteStats {
+        quint64 messages = 0;
+        quint64 bufferWrites = 0;
+        quint64 flushes = 0;
+        quint64 compressedFrames = 0;
+        quint64 compressionSavedBytes = 0;
+        quint64 savedWrites() const { return messages > bufferWrites ? messages - bufferWrites : 0; }
+    };
+
+    /*!
+     * \brief 连接池统计：当前已建立与建立中的会话数、容量上限以及因容量和空闲超时关闭的会话数。
+     */
+    struct PoolStats {
+        int openSessions = 0;
+        int pendingSessions = 0;
+        int capacity = 0;
+        quint64 evictions = 0;
+        quint64 idleClosures = 0;
+    };
+
+    /*!
+     * \brief 单条连接的传输统计，供诊断界面展示。
+     *
+     * 计数在收发路径上直接累加，吞吐按约 1 秒的时间窗计算；发送到确认的延迟按联系人统计
+     * （聊天消息的 chat_ack 与文件数据的 file_ack），以直方图给出，桶上限见 latencyBucketBounds()。
+     */
+    struct SessionStats {
+        QString peerId;
+        bool bulk = false;
+        int stripe = 0;
+        bool encrypted = false;
+        bool local = false;
+        QString address;
+        qint64 connectedMs = 0;
+        quint64 bytesIn = 0;
+        quint64 bytesOut = 0;
+        quint64 messagesIn = 0;
+        quint64 messagesOut = 0;
+        qint64 queuedBytes = 0;
+        int queuedMessages = 0;
+        bool congested = false;
+        double inRate = 0.0;
+        double outRate = 0.0;
+        quint32 reconnects = 0;
+        QVector<quint64> ackLatency;
+        qint64 rttMs = -1;
+        qint64 clockOffsetMs = 0;
+    };
+
+    // 单个联系人批量通道的最大并行连接（条带）数。
+    static constexpr int MaxBulkStripes = 8;
+
     explicit MessageRouter(QObject *parent = nullptr);
 
     bool startListening(quint16 port);
     void setLocalPeerId(const QString &peerId);
     void setLocalDisplayName(const QString &name);
-    void sendChatMessage(const PeerInfo &peer, const QString &text, const QString &roleId, const QString &roleName);
+    static QString localCapabilities();
+    /*!
+     * \brief rememberPeer 记录发现服务得到的联系人信息，入站消息据此补全监听端口与能力。
+     */
+    void rememberPeer(const PeerInfo &peer);
+    /*!
+     * \brief setPeerAlive 同步发现服务判定的存活状态：离线联系人的退避重连被放弃，重新上线时立即重连。
+     */
+    void setPeerAlive(const QString &peerId, bool alive);
+    /*!
+     * \brief sendChatMessage 发送聊天消息。
+     * \param messageId 非空时随消息发送，接收端据此回复 chat_ack 并对重发去重
+     * \param sentAt 消息的原始发送时间，发件箱重发时沿用；为空时取当前时间
+     */
+    void sendChatMessage(const PeerInfo &peer, const QString &text, const QString &roleId, const QString &roleName,
+                         const QString &messageId = QString(), const QDateTime &sentAt = QDateTime());
+    /*!
+     * \brief sendDeliveryAck 向发送方确认已收到指定消息。
+     */
+    void sendDeliveryAck(const PeerInfo &peer, const QString &messageId);
     void sendFilePayload(const PeerInfo &peer, const QString &roleId, const QString &roleName, const QJsonObject &fileInfo);
     void sendSharePayload(const PeerInfo &peer, const QJsonObject &payload);
+    void sendTransferControl(const PeerInfo &peer, const QJsonObject &payload);
+    /*!
+     * \brief localEndpoint 本机 Unix 域套接字的抽象名称，供发现服务广播；非 Linux 或创建失败时为空。
+     */
+    QString localEndpoint() const { return m_localEndpoint; }
+    /*!
+     * \brief hostIdentity 本机标识（机器 ID 的摘要），用于判断联系人是否与本机运行在同一主机上。
+     */
+    static QString hostIdentity();
+    /*!
+     * \brief sendRpcMessage 在交互通道上发送 RPC 请求、应答或取消；队列已满时返回 false，由调用方按失败处理。
+     */
+    bool sendRpcMessage(const PeerInfo &peer, const QJsonObject &payload);
+    /*!
+     * \brief sendFileChunk 在批量通道上发送文件数据块。
+     * \param stripe 批量通道的条带序号，各条带是独立的 TCP 连接，按需建立
+     * \return 对端处于背压状态时返回 false，数据块未入队，调用方应等待 peerBackpressure 解除后重试
+     */
+    bool sendFileChunk(const PeerInfo &peer, const QString &transferId, quint64 offset, const QByteArray &data,
+                       int stripe = 0);
+    /*!
+     * \brief canSendBulk 判断发往该联系人指定条带的批量数据当前是否会被接受。
+     */
+    bool canSendBulk(const PeerInfo &peer, int stripe = 0) const;
+    /*!
+     * \brief canStripe 判断能否把发往该联系人的文件数据分散到多条并行连接（对端支持 stripe/1 与批量通道）。
+     */
+    bool canStripe(const PeerInfo &peer) const;
+    /*!
+     * \brief canSendFileRegion 判断能否以零拷贝方式向该联系人发送文件区段（Linux 且对端支持 region/1 与批量通道）。
+     */
+    bool canSendFileRegion(const PeerInfo &peer) const;
+    /*!
+     * \brief sendFileRegion 在批量通道上发送文件的一段内容，由内核 sendfile 直接从文件写入套接字。
+     * \return 对端处于背压状态时返回 false，与 sendFileChunk 相同
+     */
+    bool sendFileRegion(const PeerInfo &peer, const QString &transferId, quint64 offset,
+                        const QSharedPointer<QFile> &file, qint64 length, int stripe = 0);
+    /*!
+     * \brief setWriteBatching 开启后同一轮事件循环内入队的消息在下一轮合并为一次写出。
+     */
+    void setWriteBatching(bool enabled);
+    WriteStats writeStats() const { return m_writeStats; }
+    /*!
+     * \brief setSessionLimits 设置连接池容量与空闲超时；超出容量时关闭最久未活动的空闲会话，下次发送时自动重建。
+     */
+    void setSessionLimits(int maxSessions, int idleTimeoutSeconds);
+    PoolStats poolStats() const;
+    /*!
+     * \brief sessionStats 返回当前所有已建立会话的统计快照。
+     */
+    QVector<SessionStats> sessionStats() const;
+    /*!
+     * \brief latencyBucketBounds 确认延迟直方图各桶的上限（毫秒），最后一桶统计超过最大上限的样本。
+     */
+    static QVector<int> latencyBucketBounds();
     void stop();
 
 signals:
     void messageReceived(const PeerInfo &peer, const QJsonObject &payload);
     void routerWarning(const QString &message);
+    void fileChunkReceived(const QString &peerId, const QString &transferId, quint64 offset, const QByteArray &data);
+    /*!
+     * \brief sessionClosed 与联系人的交互会话意外断开（或无法建立），其上在途的聊天、RPC 与传输控制消息可能已丢失。
+     *
+     * 连接池因容量或空闲超时主动回收的会话没有在途数据，不会触发本信号。
+     */
+    void sessionClosed(const QString &peerId);
+    /*!
+     * \brief stripeClosed 批量通道的某条连接意外断开（或无法建立），只影响经该条带发送的文件数据。
+     */
+    void stripeClosed(const QString &peerId, int stripe);
+    /*!
+     * \brief peerBackpressure 某条连接的待发送数据越过高水位（congested=true）或回落到低水位以下时触发。
+     */
+    void peerBackpressure(const QString &peerId, bool congested);
+    /*!
+     * \brief clockEstimateUpdated 联系人的往返时延或时钟偏差估计更新时触发。
+     * \param offsetMs 对端时钟减本机时钟的毫秒数
+     */
+    void clockEstimateUpdated(const QString &peerId, qint64 offsetMs, qint64 rttMs);
 
 private slots:
     void handleNewConnection();
     void readSocket();
 
 private:
-    QTcpSocket *ensureSession(const PeerInfo &peer);
+    /*!
+     * \brief 连接所属通道：交互通道承载聊天与控制消息，批量通道只承载文件数据块。
+     */
+    enum class Lane { Interactive, Bulk };
+
+    /*!
+     * \brief 发送消息的类别，决定连接拥塞时的处理策略：
+     * 控制消息始终入队；交互消息入队直至硬上限后丢弃；批量数据在拥塞期间拒绝入队，由调用方延后重发。
+     */
+    enum class MessageClass { Interactive, Control, Bulk };
+
+    /*!
+     * \brief 待发送的消息；file 非空时表示一段文件区段（transferId 取自 object），写出时走零拷贝路径。
+     */
+    struct PendingMessage {
+        QJsonObject object;
+        QByteArray binary;
+        QSharedPointer<QFile> file;
+        qint64 fileOffset = 0;
+        qint64 fileLength = 0;
+    };
+
+    /*!
+     * \brief 正在进行的零拷贝写出：先写帧头，再由 sendfile 写文件内容，套接字写满时等待可写通知。
+     */
+    struct RawSend {
+        QByteArray header;
+        int headerSent = 0;
+        QSharedPointer<QFile> file;
+        qint64 offset = 0;
+        qint64 remaining = 0;
+    };
+
+    /*!
+     * \brief 约 1 秒的吞吐时间窗：窗口结束时才计算一次速率，常开也几乎没有开销。
+     */
+    struct RateWindow {
+        qint64 start = 0;
+        quint64 bytes = 0;
+        double rate = 0.0;
+        void add(qint64 now, quint64 count);
+        double current(qint64 now) const;
+    };
+
+    static constexpr int LatencyBucketCount = 13;
+
+    /*!
+     * \brief 按联系人累计的统计：会话重建次数与发送到确认的延迟直方图，以及计算延迟所需的发送时刻。
+     */
+    struct PeerCounters {
+        QSet<QString> openedSessions;
+        quint32 reconnects = 0;
+        std::array<quint64, LatencyBucketCount> ackLatency{};
+        QHash<QString, qint64> pendingAcks;
+        QHash<QString, QMap<quint64, qint64>> chunkMarks;
+    };
+
+    /*!
+     * \brief 时钟探测结果：保留最近若干次 ping/pong 样本，取往返时延最小的一次作为估计（NTP 时钟滤波）。
+     */
+    struct ClockSample {
+        qint64 rtt = 0;
+        qint64 offset = 0;
+    };
+
+    struct ClockEstimate {
+        QList<ClockSample> samples;
+        qint64 rtt = -1;
+        qint64 offset = 0;
+    };
+
+    /*!
+     * \brief 每条 TCP 连接的收发状态：接收解码器、发送时是否使用二进制分帧及 CBOR 编码、所属通道以及发送队列。
+     *
+     * 发送队列保存未编码的消息，写出时才按本连接的编码格式序列化，重复连接合并时可直接移交给保留的连接。
+     */
+    struct SocketState {
+        WireProtocol::FrameDecoder decoder;
+        bool framed = false;
+        bool cbor = false;
+        bool compress = false;
+        Lane lane = Lane::Interactive;
+        int stripe = 0;
+        bool initiatedLocally = false;
+        // 同机连接：底层是 Unix 域套接字，没有 IP 地址，也不需要 TCP 选项与会话加密。
+        bool local = false;
+        qint64 lastActivity = 0;
+        // 重复连接合并后被淘汰：不再发送新消息，但继续接收，直到对端确认或静默后关闭。
+        bool retiring = false;
+        qint64 retiringSince = 0;
+        // 保留的连接在被淘汰的连接收到 session_retire_ack 前暂停收发，保证消息顺序不因换连接而错乱。
+        QPointer<QTcpSocket> heldFor;
+        bool drainScheduled = false;
+        QQueue<PendingMessage> outbound;
+        qint64 queuedBytes = 0;
+        bool congested = false;
+        bool flushScheduled = false;
+        bool rawActive = false;
+        RawSend raw;
+        QSocketNotifier *writeNotifier = nullptr;
+        qint64 connectedAt = 0;
+        quint64 bytesIn = 0;
+        quint64 bytesOut = 0;
+        quint64 messagesIn = 0;
+        quint64 messagesOut = 0;
+        RateWindow inRate;
+        RateWindow outRate;
+        // 会话加密：sealing 表示握手进行中，期间暂停写出；sealed 后收发的每一帧都经认证加密。
+        bool sealing = false;
+        bool sealed = false;
+        bool sealResuming = false;
+        QByteArray sealPrivate;
+        QByteArray sealNonce;
+        SessionCrypto::Cipher sendCipher;
+        SessionCrypto::Cipher recvCipher;
+    };
+
+    /*!
+     * \brief 对端签发的会话票据及对应的恢复秘密，重连时凭票据跳过完整的密钥交换。
+     */
+    struct SessionTicket {
+        QByteArray ticket;
+        QByteArray secret;
+    };
+
+    /*!
+     * \brief 待建立的会话：Connecting 表示正在并行尝试各地址，Backoff 表示失败后等待重连；
+     * 连接成功后转为已连接会话（m_peerSessions/m_bulkSessions），暂存消息随即写出。
+     */
+    enum class PendingState { Connecting, Backoff };
+
+    struct PendingSession {
+        PeerInfo peer;
+        Lane lane = Lane::Interactive;
+        int stripe = 0;
+        PendingState state = PendingState::Connecting;
+        int failures = 0;
+        quint64 generation = 0;
+        QList<QPointer<QTcpSocket>> attempts;
+        QQueue<PendingMessage> messages;
+        qint64 queuedBytes = 0;
+        bool congested = false;
+    };
+
+    static Lane laneFor(const PeerInfo &peer, Lane lane);
+    static QString sessionKey(const QString &peerId, Lane lane, int stripe = 0);
+    static QString stripeKey(const QString &peerId, int stripe);
+    static qint64 pendingSize(const PendingMessage &message);
+    QTcpSocket *connectedSession(const QString &peerId, Lane lane, int stripe = 0) const;
+    bool sendToPeer(const PeerInfo &peer, Lane lane, const QJsonObject &object, MessageClass messageClass,
+                    const QByteArray &binary = QByteArray(), int stripe = 0);
+    bool sendToPeer(const PeerInfo &peer, Lane lane, const PendingMessage &message, MessageClass messageClass,
+                    int stripe = 0);
+    QList<QHostAddress> candidateAddresses(const PeerInfo &peer) const;
+    void startConnecting(const QString &key);
+    void handleAttemptConnected(const QString &key, QTcpSocket *socket);
+    void handleAttemptFailed(const QString &key, QTcpSocket *socket);
+    void handleConnectFailure(const QString &key);
+    void abandonPendingSession(const QString &key);
+    void discardAttempt(QTcpSocket *socket);
+    void registerSession(QTcpSocket *socket, const QString &peerId, Lane lane, int stripe = 0);
+    void retireSocket(QTcpSocket *loser, QTcpSocket *winner, bool acknowledge = false);
+    void handleRetire(QTcpSocket *socket, const QString &type);
+    void scheduleRetireCheck(QTcpSocket *socket);
+    void closeRetired(QTcpSocket *socket);
+    bool isHeld(const SocketState &state) const;
+    void releaseHeld(QTcpSocket *loser);
+    void releaseSession(QTcpSocket *socket);
+    void enforcePoolLimit(QTcpSocket *keep);
+    void reapIdleSessions();
+    bool isIdle(QTcpSocket *socket, const SocketState &state) const;
+    QByteArray encodeMessage(SocketState &state, const PendingMessage &message);
+    QByteArray encodeFrame(SocketState &state, WireProtocol::FrameType type, const QByteArray &body);
+    void drainSocket(QTcpSocket *socket);
     void attachSocketSignals(QTcpSocket *socket);
-    void sendJson(QTcpSocket *socket, const QJsonObject &object);
+    bool sendMessage(QTcpSocket *socket, const QJsonObject &object, MessageClass messageClass,
+                     const QByteArray &binary = QByteArray());
+    bool sendMessage(QTcpSocket *socket, const PendingMessage &message, MessageClass messageClass);
+    void startRawSend(QTcpSocket *socket, const PendingMessage &message);
+    bool pumpRawSend(QTcpSocket *socket);
+    void flushOutbound(QTcpSocket *socket);
+    void scheduleFlush(QTcpSocket *socket);
+    void applyLaneSocketOptions(QTcpSocket *socket, Lane lane);
+    void updateBackpressure(QTcpSocket *socket);
+    void dispatchFrame(QTcpSocket *socket, WireProtocol::Frame frame);
+    bool canSeal(const PeerInfo &peer) const;
+    bool isSameHost(const PeerInfo &peer) const;
+    bool startLocalListener(quint16 port);
+    void closeLocalListener();
+    void acceptLocalConnections();
+    QTcpSocket *adoptLocalSocket(int fd);
+    QTcpSocket *connectLocal(const PeerInfo &peer, Lane lane, int stripe);
+    void beginSeal(QTcpSocket *socket, const QString &peerId);
+    void handleSealHandshake(QTcpSocket *socket, const QString &type, const QJsonObject &object);
+    void writeHandshake(QTcpSocket *socket, const QJsonObject &object);
+    bool openSealedFrame(QTcpSocket *socket, WireProtocol::Frame *frame);
+    /*!
+     * \brief refusesPlaintext 已知对端支持加密、本端也可加密时拒绝未加密的业务帧并断开连接。
+     */
+    bool refusesPlaintext(QTcpSocket *socket, quint16 flags, const QString &peerId);
     void cleanupSocket(QTcpSocket *socket);
+    void countBytesOut(SocketState &state, quint64 count);
+    void markChunkSent(const QString &peerId, const QString &transferId, quint64 end);
+    void recordAckLatency(const QString &peerId, qint64 sentAt);
+    void handleAckForStats(const QString &peerId, const QString &type, const QJsonObject &object);
+    void probeSessions();
+    void sendProbe(QTcpSocket *socket, const QJsonObject &object);
+    void handleClockProbe(QTcpSocket *socket, const QString &type, const QJsonObject &object);
 
     QTcpServer m_server;
+    QTimer m_idleTimer;
+    QTimer m_probeTimer;
+    QElapsedTimer m_clock;
     QString m_localPeerId;
     QString m_localDisplayName;
     QHash<QString, QPointer<QTcpSocket>> m_peerSessions;
+    QHash<QString, QPointer<QTcpSocket>> m_bulkSessions; // 键为 stripeKey(peerId, stripe)
     QHash<QTcpSocket *, QString> m_socketToPeer;
-    QHash<QTcpSocket *, QByteArray> m_pendingBuffers;
+    QHash<QTcpSocket *, SocketState> m_socketStates;
+    QHash<QString, PeerInfo> m_knownPeers;
+    QHash<QString, QList<QHostAddress>> m_peerAddresses;
+    QSet<QString> m_offlinePeers;
+    QHash<QString, PendingSession> m_pendingSessions;
+    WriteStats m_writeStats;
+    PoolStats m_poolStats;
+    QHash<QString, PeerCounters> m_peerCounters;
+    QHash<QString, ClockEstimate> m_clocks;
+    QHash<QString, SessionTicket> m_sessionTickets;
+    int m_localListenFd = -1;
+    QSocketNotifier *m_localNotifier = nullptr;
+    QString m_localEndpoint;
+    int m_maxSessions = 256;
+    qint64 m_idleTimeoutMs = 10 * 60 * 1000;
+    bool m_writeBatching = false;
 };
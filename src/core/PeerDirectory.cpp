@@ -17,32 +17,73 @@ int PeerDirectory::peerCount() const {
     return m_peers.size();
 }
 
-void PeerDirectory::upsertPeer(const PeerInfo &info) {
-    int index = indexOf(info.id, info.address);
-    if (index >= 0) {
-        m_peers[index] = info;
-    } else {
-        m_peers.append(info);
+bool PeerDirectory::upsertPeer(const PeerInfo &info) {
+    const QString key = rowKey(info.id, info.address);
+    const auto it = m_rows.constFind(key);
+    if (it != m_rows.constEnd()) {
+        const int row = it.value();
+        PeerInfo &current = m_peers[row];
+        const bool changed = !sameContent(current, info);
+        current = info;
+        if (changed) {
+            emit peerChanged(row);
+            emit peerListChanged();
+        }
+        return changed;
     }
+    const int row = m_peers.size();
+    emit peerAboutToBeAdded(row);
+    m_peers.append(info);
+    m_rows.insert(key, row);
+    emit peerAdded(row);
     emit peerListChanged();
+    return true;
 }
 
 void PeerDirectory::removePeer(const QString &peerId) {
     for (int row = 0; row < m_peers.size(); ++row) {
         if (m_peers.at(row).id == peerId) {
+            emit peerAboutToBeRemoved(row);
             m_peers.removeAt(row);
+            rebuildIndex();
+            emit peerRemoved(row);
             emit peerListChanged();
             break;
         }
     }
 }
 
-int PeerDirectory::indexOf(const QString &peerId, const QHostAddress &address) const {
-    for (int i = 0; i < m_peers.size(); ++i) {
-        const PeerInfo &candidate = m_peers.at(i);
-        if (candidate.id == peerId && candidate.address == address) {
-            return i;
+void PeerDirectory::setPresence(const QString &peerId, PeerPresence presence) {
+    bool changed = false;
+    for (int row = 0; row < m_peers.size(); ++row) {
+        PeerInfo &peer = m_peers[row];
+        if (peer.id == peerId && peer.presence != presence) {
+            peer.presence = presence;
+            changed = true;
+            emit peerChanged(row);
         }
     }
-    return -1;
+    if (changed) {
+        emit peerListChanged();
+    }
+}
+
+QString PeerDirectory::rowKey(const QString &peerId, const QHostAddress &address) {
+    return peerId + QLatin1Char('\n') + address.toString();
+}
+
+bool PeerDirectory::sameContent(const PeerInfo &left, const PeerInfo &right) {
+    // lastSeen 每次心跳都会变化，不计入比较。
+    return left.displayName == right.displayName && left.listenPort == right.listenPort &&
+           left.capabilities == right.capabilities && left.hostId == right.hostId &&
+           left.localEndpoint == right.localEndpoint && left.presence == right.presence &&
+           left.profileDigest == right.profileDigest;
+}
+
+void PeerDirectory::rebuildIndex() {
+    m_rows.clear();
+    m_rows.reserve(m_peers.size());
+    for (int row = 0; row < m_peers.size(); ++row) {
+        m_rows.insert(rowKey(m_peers.at(row).id, m_peers.at(row).address), row);
+    }
 }
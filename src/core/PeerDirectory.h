@@ -2,10 +2,17 @@
 
 #include "PeerInfo.h"
 
+#include <QHash>
 #include <QObject>
 #include <QList>
 #include <QVector>
 
+/*!
+ * \brief PeerDirectory 维护联系人列表（同一联系人的每个地址各占一行），只在内容真正变化时通知界面。
+ *
+ * 新增与删除行分别以 peerAboutToBeAdded/peerAdded、peerAboutToBeRemoved/peerRemoved 成对通知，
+ * 名称、能力或在线状态变化以 peerChanged 通知；仅 lastSeen 变化的心跳只更新内存中的记录。
+ */
 class PeerDirectory : public QObject {
     Q_OBJECT
 
@@ -17,14 +24,31 @@ public:
     int peerCount() const;
 
 public slots:
-    void upsertPeer(const PeerInfo &info);
+    /*!
+     * \brief upsertPeer 合并一条发现结果。
+     * \return 新增了联系人或其名称、端口、能力、资料摘要、在线状态有变化时返回 true
+     */
+    bool upsertPeer(const PeerInfo &info);
     void removePeer(const QString &peerId);
+    void setPresence(const QString &peerId, PeerPresence presence);
 
 signals:
+    void peerAboutToBeAdded(int row);
+    void peerAdded(int row);
+    void peerAboutToBeRemoved(int row);
+    void peerRemoved(int row);
+    void peerChanged(int row);
+    /*!
+     * \brief peerListChanged 每次新增、删除或内容变化之后发出一次，供只关心整体状态的界面使用。
+     */
     void peerListChanged();
 
 private:
-    int indexOf(const QString &peerId, const QHostAddress &address) const;
+    static QString rowKey(const QString &peerId, const QHostAddress &address);
+    static bool sameContent(const PeerInfo &left, const PeerInfo &right);
+    void rebuildIndex();
 
     QVector<PeerInfo> m_peers;
+    // 行键（联系人 ID 与地址）到行号的索引，心跳合并无需线性查找。
+    QHash<QString, int> m_rows;
 };
@@ -4,6 +4,29 @@
 #include <QHostAddress>
 #include <QMetaType>
 #include <QString>
+#include <QStringList>
+
+/*!
+ * \brief 通过发现报文在 PeerInfo::capabilities 中协商的能力标识（逗号分隔）。
+ */
+namespace PeerCapability {
+constexpr char Framing[] = "frame/1";
+constexpr char ChunkedTransfer[] = "xfer/1";
+constexpr char BulkLane[] = "lane/1";
+constexpr char CborEncoding[] = "cbor/1";
+constexpr char Compression[] = "zlib/1";
+constexpr char FileRegion[] = "region/1";
+constexpr char Striping[] = "stripe/1";
+constexpr char DeliveryAck[] = "ack/1";
+constexpr char ClockSync[] = "ping/1";
+constexpr char SealedSession[] = "seal/1";
+constexpr char Rpc[] = "rpc/1";
+} // namespace PeerCapability
+
+/*!
+ * \brief 联系人在线状态，由发现服务按心跳到达情况判定：漏掉两次心跳转为离开，长时间无心跳转为离线。
+ */
+enum class PeerPresence { Offline, Online, Away };
 
 struct PeerInfo {
     QString id;
@@ -12,6 +35,17 @@ struct PeerInfo {
     quint16 listenPort = 0;
     QDateTime lastSeen;
     QString capabilities;
+    // 同机直连：hostId 为主机标识摘要，localEndpoint 为对端 Unix 域套接字的抽象名称，二者均为空表示不支持。
+    QString hostId;
+    QString localEndpoint;
+    PeerPresence presence = PeerPresence::Offline;
+    // 发现报文中的资料摘要，变化时说明对方的名称、能力或个人资料已更新。
+    quint64 profileDigest = 0;
+
+    bool supports(const char *capability) const {
+        return capabilities.split(QLatin1Char(','), Qt::SkipEmptyParts).contains(QLatin1String(capability));
+    }
 };
 
 Q_DECLARE_METATYPE(PeerInfo)
+Q_DECLARE_METATYPE(PeerPresence)
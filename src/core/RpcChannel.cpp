@@ -0,0 +1,143 @@
+#include "RpcChannel.h"
+
+#include <QTimer>
+
+namespace {
+// 同时处理的对端请求上限，超出时直接回复 busy，防止对端无节制地堆积请求。
+constexpr int MaxServingRequests = 1024;
+} // namespace
+
+RpcChannel::RpcChannel(MessageRouter *router, QObject *parent) : QObject(parent), m_router(router) {
+    if (m_router) {
+        connect(m_router, &MessageRouter::messageReceived, this, &RpcChannel::handleMessage);
+        connect(m_router, &MessageRouter::sessionClosed, this, &RpcChannel::handleSessionClosed);
+    }
+}
+
+quint64 RpcChannel::reserveRequestId() {
+    return m_nextRequestId.fetch_add(1) + 1;
+}
+
+void RpcChannel::call(const PeerInfo &peer, quint64 requestId, const QString &method, const QJsonObject &params,
+                      int timeoutMs) {
+    if (!m_router || peer.id.isEmpty()) {
+        emit callFailed(peer.id, requestId, QStringLiteral("unreachable"));
+        return;
+    }
+    m_pending.insert(requestId, peer);
+    const QJsonObject object{
+        {QStringLiteral("type"), QStringLiteral("rpc")},
+        {QStringLiteral("rpcId"), QString::number(requestId)},
+        {QStringLiteral("method"), method},
+        {QStringLiteral("params"), params}
+    };
+    if (!m_router->sendRpcMessage(peer, object)) {
+        fail(requestId, QStringLiteral("busy"));
+        return;
+    }
+    QTimer::singleShot(timeoutMs, this, [this, requestId]() { fail(requestId, QStringLiteral("timeout")); });
+}
+
+void RpcChannel::cancel(quint64 requestId) {
+    const auto it = m_pending.constFind(requestId);
+    if (it == m_pending.constEnd()) {
+        return;
+    }
+    const PeerInfo peer = it.value();
+    m_pending.erase(it);
+    m_router->sendRpcMessage(peer, QJsonObject{{QStringLiteral("type"), QStringLiteral("rpc_cancel")},
+                                               {QStringLiteral("rpcId"), QString::number(requestId)}});
+}
+
+void RpcChannel::reply(const QString &peerId, const QString &rpcId, const QJsonObject &result) {
+    sendReply(peerId, rpcId, QJsonObject{{QStringLiteral("result"), result}});
+}
+
+void RpcChannel::replyError(const QString &peerId, const QString &rpcId, const QString &error) {
+    sendReply(peerId, rpcId, QJsonObject{{QStringLiteral("error"), error}});
+}
+
+void RpcChannel::sendReply(const QString &peerId, const QString &rpcId, const QJsonObject &body) {
+    const PeerInfo peer = m_serving.take(servingKey(peerId, rpcId));
+    if (peer.id.isEmpty()) {
+        return;
+    }
+    QJsonObject object = body;
+    object.insert(QStringLiteral("type"), QStringLiteral("rpc_reply"));
+    object.insert(QStringLiteral("rpcId"), rpcId);
+    m_router->sendRpcMessage(peer, object);
+}
+
+void RpcChannel::fail(quint64 requestId, const QString &error) {
+    const auto it = m_pending.constFind(requestId);
+    if (it == m_pending.constEnd()) {
+        return;
+    }
+    const QString peerId = it->id;
+    m_pending.erase(it);
+    emit callFailed(peerId, requestId, error);
+}
+
+void RpcChannel::handleMessage(const PeerInfo &peer, const QJsonObject &payload) {
+    const QString type = payload.value(QStringLiteral("type")).toString();
+    const QString rpcId = payload.value(QStringLiteral("rpcId")).toString();
+    if (peer.id.isEmpty() || rpcId.isEmpty()) {
+        return;
+    }
+    if (type == QStringLiteral("rpc")) {
+        const QString key = servingKey(peer.id, rpcId);
+        if (m_serving.contains(key)) {
+            return;
+        }
+        m_serving.insert(key, peer);
+        if (m_serving.size() > MaxServingRequests) {
+            replyError(peer.id, rpcId, QStringLiteral("busy"));
+            return;
+        }
+        emit requestReceived(peer, rpcId, payload.value(QStringLiteral("method")).toString(),
+                             payload.value(QStringLiteral("params")).toObject());
+    } else if (type == QStringLiteral("rpc_reply")) {
+        bool ok = false;
+        const quint64 requestId = rpcId.toULongLong(&ok);
+        const auto it = m_pending.constFind(requestId);
+        // 应答只接受来自请求目标的联系人，迟到（已超时或已取消）的应答直接丢弃。
+        if (!ok || it == m_pending.constEnd() || it->id != peer.id) {
+            return;
+        }
+        m_pending.erase(it);
+        if (payload.contains(QStringLiteral("error"))) {
+            emit callFailed(peer.id, requestId, payload.value(QStringLiteral("error")).toString());
+        } else {
+            emit replyReceived(peer.id, requestId, payload.value(QStringLiteral("result")).toObject());
+        }
+    } else if (type == QStringLiteral("rpc_cancel")) {
+        if (m_serving.remove(servingKey(peer.id, rpcId)) > 0) {
+            emit requestCancelled(peer.id, rpcId);
+        }
+    }
+}
+
+void RpcChannel::handleSessionClosed(const QString &peerId) {
+    // 交互会话断开后在途的应答已随连接丢失，立即失败而不是等到超时；批量条带的关闭不影响 RPC。
+    QList<quint64> lost;
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+        if (it->id == peerId) {
+            lost.append(it.key());
+        }
+    }
+    for (const quint64 requestId : std::as_const(lost)) {
+        fail(requestId, QStringLiteral("disconnected"));
+    }
+    const QString prefix = peerId + QLatin1Char('\n');
+    for (auto it = m_serving.begin(); it != m_serving.end();) {
+        if (it.key().startsWith(prefix)) {
+            it = m_serving.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+QString RpcChannel::servingKey(const QString &peerId, const QString &rpcId) {
+    return peerId + QLatin1Char('\n') + rpcId;
+}
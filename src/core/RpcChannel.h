@@ -0,0 +1,69 @@
+#pragma once
+
+#include "MessageRouter.h"
+
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+
+/*!
+ * \brief RpcChannel 在 MessageRouter 之上提供请求/应答调用：每个请求带唯一 ID，应答按 ID 关联，
+ *        同一会话上可同时有任意多个请求在途，支持逐个超时与取消。
+ *
+ * 线路格式（交互通道）：
+ *   rpc        { rpcId, method, params }
+ *   rpc_reply  { rpcId, result } 或 { rpcId, error }
+ *   rpc_cancel { rpcId }
+ * 与 MessageRouter 运行在同一网络线程中；服务端的请求以 requestReceived 交给上层处理，上层调用 reply 作答。
+ */
+class RpcChannel : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultTimeoutMs = 15 * 1000;
+
+    explicit RpcChannel(MessageRouter *router, QObject *parent = nullptr);
+
+    /*!
+     * \brief reserveRequestId 分配请求 ID，可在任意线程调用，便于调用方先登记再把请求投递到网络线程。
+     */
+    quint64 reserveRequestId();
+    /*!
+     * \brief call 向联系人发起请求，结果以 replyReceived 或 callFailed 报告，二者必有其一且只出现一次。
+     */
+    void call(const PeerInfo &peer, quint64 requestId, const QString &method, const QJsonObject &params,
+              int timeoutMs = DefaultTimeoutMs);
+    /*!
+     * \brief cancel 放弃等待应答并通知对端停止处理，此后不再为该请求发出任何信号。
+     */
+    void cancel(quint64 requestId);
+    /*!
+     * \brief reply 应答收到的请求；请求已被对端取消或会话已断开时直接丢弃。
+     */
+    void reply(const QString &peerId, const QString &rpcId, const QJsonObject &result);
+    void replyError(const QString &peerId, const QString &rpcId, const QString &error);
+
+signals:
+    void replyReceived(const QString &peerId, quint64 requestId, const QJsonObject &result);
+    void callFailed(const QString &peerId, quint64 requestId, const QString &error);
+    void requestReceived(const PeerInfo &peer, const QString &rpcId, const QString &method,
+                         const QJsonObject &params);
+    void requestCancelled(const QString &peerId, const QString &rpcId);
+
+private:
+    void handleMessage(const PeerInfo &peer, const QJsonObject &payload);
+    void handleSessionClosed(const QString &peerId);
+    void sendReply(const QString &peerId, const QString &rpcId, const QJsonObject &body);
+    void fail(quint64 requestId, const QString &error);
+    static QString servingKey(const QString &peerId, const QString &rpcId);
+
+    MessageRouter *m_router = nullptr;
+    std::atomic<quint64> m_nextRequestId{0};
+    // 等待应答的请求及其目标联系人。
+    QHash<quint64, PeerInfo> m_pending;
+    // 正在处理的对端请求，键为 peerId 与 rpcId 的组合。
+    QHash<QString, PeerInfo> m_serving;
+};
@@ -0,0 +1,287 @@
+#include "SessionCrypto.h"
+
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <QtEndian>
+
+#include <atomic>
+#include <cstring>
+
+#ifdef NWT_SESSION_CRYPTO
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+#endif
+
+namespace SessionCrypto {
+namespace {
+constexpr int GcmNonceSize = 12;
+constexpr int TicketHeaderSize = 8;
+constexpr int TicketBodySize = 8 + KeySize;
+
+#ifdef NWT_SESSION_CRYPTO
+// 票据密钥只存在于本进程内存中，进程退出即作废，无需持久化也无需轮换。
+struct TicketKey {
+    Cipher cipher;
+    std::atomic<quint64> sequence{0};
+
+    TicketKey() { cipher.init(randomBytes(KeySize), randomBytes(SaltSize)); }
+};
+
+TicketKey &ticketKey() {
+    static TicketKey key;
+    return key;
+}
+
+QByteArray ticketAad(const char *header, const QString &peerId) {
+    return QByteArray(header, TicketHeaderSize) + peerId.toUtf8();
+}
+#endif
+} // namespace
+
+bool available() {
+#ifdef NWT_SESSION_CRYPTO
+    return true;
+#else
+    return false;
+#endif
+}
+
+QByteArray randomBytes(int size) {
+    QByteArray bytes(size, Qt::Uninitialized);
+#ifdef NWT_SESSION_CRYPTO
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(bytes.data()), size) == 1) {
+        return bytes;
+    }
+#endif
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(bytes.data()), size / 4);
+    for (int i = size / 4 * 4; i < size; ++i) {
+        bytes[i] = static_cast<char>(QRandomGenerator::system()->bounded(256));
+    }
+    return bytes;
+}
+
+bool generateKeyPair(QByteArray *privateKey, QByteArray *publicKey) {
+#ifdef NWT_SESSION_CRYPTO
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, nullptr);
+    EVP_PKEY *key = nullptr;
+    bool ok = ctx && EVP_PKEY_keygen_init(ctx) == 1 && EVP_PKEY_keygen(ctx, &key) == 1;
+    if (ok) {
+        size_t privateLength = KeySize;
+        size_t publicLength = PublicKeySize;
+        privateKey->resize(KeySize);
+        publicKey->resize(PublicKeySize);
+        ok = EVP_PKEY_get_raw_private_key(key, reinterpret_cast<unsigned char *>(privateKey->data()),
+                                          &privateLength) == 1 &&
+             EVP_PKEY_get_raw_public_key(key, reinterpret_cast<unsigned char *>(publicKey->data()),
+                                         &publicLength) == 1;
+    }
+    EVP_PKEY_free(key);
+    EVP_PKEY_CTX_free(ctx);
+    return ok;
+#else
+    Q_UNUSED(privateKey);
+    Q_UNUSED(publicKey);
+    return false;
+#endif
+}
+
+QByteArray sharedSecret(const QByteArray &privateKey, const QByteArray &peerPublicKey) {
+#ifdef NWT_SESSION_CRYPTO
+    if (privateKey.size() != KeySize || peerPublicKey.size() != PublicKeySize) {
+        return {};
+    }
+    EVP_PKEY *local = EVP_PKEY_new_raw_private_key(
+        EVP_PKEY_X25519, nullptr, reinterpret_cast<const unsigned char *>(privateKey.constData()), KeySize);
+    EVP_PKEY *remote = EVP_PKEY_new_raw_public_key(
+        EVP_PKEY_X25519, nullptr, reinterpret_cast<const unsigned char *>(peerPublicKey.constData()), PublicKeySize);
+    EVP_PKEY_CTX *ctx = local ? EVP_PKEY_CTX_new(local, nullptr) : nullptr;
+    QByteArray secret(KeySize, Qt::Uninitialized);
+    size_t length = KeySize;
+    // 低阶点等无效公钥会得到全零结果，OpenSSL 在 derive 时即返回失败。
+    const bool ok = ctx && remote && EVP_PKEY_derive_init(ctx) == 1 && EVP_PKEY_derive_set_peer(ctx, remote) == 1 &&
+                    EVP_PKEY_derive(ctx, reinterpret_cast<unsigned char *>(secret.data()), &length) == 1 &&
+                    length == KeySize;
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(remote);
+    EVP_PKEY_free(local);
+    return ok ? secret : QByteArray();
+#else
+    Q_UNUSED(privateKey);
+    Q_UNUSED(peerPublicKey);
+    return {};
+#endif
+}
+
+bool deriveSessionKeys(const QByteArray &secret, const QByteArray &clientNonce, const QByteArray &serverNonce,
+                       SessionKeys *keys) {
+#ifdef NWT_SESSION_CRYPTO
+    static const QByteArray info = QByteArrayLiteral("nwt seal/1 session keys");
+    const QByteArray salt = clientNonce + serverNonce;
+    constexpr int MaterialSize = KeySize * 3 + SaltSize * 2;
+    QByteArray material(MaterialSize, Qt::Uninitialized);
+    size_t length = MaterialSize;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    const bool ok =
+        ctx && EVP_PKEY_derive_init(ctx) == 1 && EVP_PKEY_CTX_set_hkdf_md(ctx, EVP_sha256()) == 1 &&
+        EVP_PKEY_CTX_set1_hkdf_salt(ctx, reinterpret_cast<const unsigned char *>(salt.constData()), salt.size()) ==
+            1 &&
+        EVP_PKEY_CTX_set1_hkdf_key(ctx, reinterpret_cast<const unsigned char *>(secret.constData()), secret.size()) ==
+            1 &&
+        EVP_PKEY_CTX_add1_hkdf_info(ctx, reinterpret_cast<const unsigned char *>(info.constData()), info.size()) ==
+            1 &&
+        EVP_PKEY_derive(ctx, reinterpret_cast<unsigned char *>(material.data()), &length) == 1 &&
+        length == MaterialSize;
+    EVP_PKEY_CTX_free(ctx);
+    if (!ok) {
+        return false;
+    }
+    keys->clientKey = material.mid(0, KeySize);
+    keys->serverKey = material.mid(KeySize, KeySize);
+    keys->resumeSecret = material.mid(KeySize * 2, KeySize);
+    keys->clientSalt = material.mid(KeySize * 3, SaltSize);
+    keys->serverSalt = material.mid(KeySize * 3 + SaltSize, SaltSize);
+    return true;
+#else
+    Q_UNUSED(secret);
+    Q_UNUSED(clientNonce);
+    Q_UNUSED(serverNonce);
+    Q_UNUSED(keys);
+    return false;
+#endif
+}
+
+QByteArray issueTicket(const QByteArray &resumeSecret, const QString &peerId) {
+#ifdef NWT_SESSION_CRYPTO
+    // 票据布局：序号(8) | 密文[签发时间(8) | 恢复秘密(32)] | 认证标签(16)，序号兼作 GCM nonce，对端 ID 作为附加认证数据。
+    if (resumeSecret.size() != KeySize) {
+        return {};
+    }
+    TicketKey &key = ticketKey();
+    const quint64 sequence = key.sequence.fetch_add(1) + 1;
+    QByteArray ticket(TicketHeaderSize + TicketBodySize + TagSize, Qt::Uninitialized);
+    char *cursor = ticket.data();
+    qToBigEndian<quint64>(sequence, cursor);
+    qToBigEndian<qint64>(QDateTime::currentSecsSinceEpoch(), cursor + TicketHeaderSize);
+    std::memcpy(cursor + TicketHeaderSize + 8, resumeSecret.constData(), KeySize);
+    const QByteArray aad = ticketAad(cursor, peerId);
+    if (!key.cipher.sealAt(sequence, cursor + TicketHeaderSize, TicketBodySize, aad.constData(), aad.size(),
+                           cursor + TicketHeaderSize + TicketBodySize)) {
+        return {};
+    }
+    return ticket;
+#else
+    Q_UNUSED(resumeSecret);
+    Q_UNUSED(peerId);
+    return {};
+#endif
+}
+
+bool redeemTicket(const QByteArray &ticket, const QString &peerId, QByteArray *resumeSecret) {
+#ifdef NWT_SESSION_CRYPTO
+    if (ticket.size() != TicketHeaderSize + TicketBodySize + TagSize) {
+        return false;
+    }
+    QByteArray plain = ticket;
+    char *cursor = plain.data();
+    const quint64 sequence = qFromBigEndian<quint64>(cursor);
+    const QByteArray aad = ticketAad(cursor, peerId);
+    if (!ticketKey().cipher.openAt(sequence, cursor + TicketHeaderSize, TicketBodySize, aad.constData(), aad.size(),
+                                   cursor + TicketHeaderSize + TicketBodySize)) {
+        return false;
+    }
+    const qint64 issuedAt = qFromBigEndian<qint64>(cursor + TicketHeaderSize);
+    const qint64 age = QDateTime::currentSecsSinceEpoch() - issuedAt;
+    if (age < 0 || age > TicketLifetimeSecs) {
+        return false;
+    }
+    *resumeSecret = plain.mid(TicketHeaderSize + 8, KeySize);
+    return true;
+#else
+    Q_UNUSED(ticket);
+    Q_UNUSED(peerId);
+    Q_UNUSED(resumeSecret);
+    return false;
+#endif
+}
+
+bool Cipher::init(const QByteArray &key, const QByteArray &salt) {
+#ifdef NWT_SESSION_CRYPTO
+    if (key.size() != KeySize || salt.size() != SaltSize) {
+        return false;
+    }
+    std::shared_ptr<EVP_CIPHER_CTX> ctx(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+    // EVP 会自动选用 AES-NI / ARMv8 加密扩展等硬件实现。
+    if (!ctx || EVP_CipherInit_ex(ctx.get(), EVP_aes_256_gcm(), nullptr,
+                                  reinterpret_cast<const unsigned char *>(key.constData()), nullptr, 1) != 1) {
+        return false;
+    }
+    m_ctx = ctx;
+    m_salt = salt;
+    m_sequence = 0;
+    return true;
+#else
+    Q_UNUSED(key);
+    Q_UNUSED(salt);
+    return false;
+#endif
+}
+
+bool Cipher::seal(char *data, int length, const char *aad, int aadLength, char *tag) {
+    return run(true, m_sequence++, data, length, aad, aadLength, tag);
+}
+
+bool Cipher::open(char *data, int length, const char *aad, int aadLength, const char *tag) {
+    return run(false, m_sequence++, data, length, aad, aadLength, const_cast<char *>(tag));
+}
+
+bool Cipher::sealAt(quint64 sequence, char *data, int length, const char *aad, int aadLength, char *tag) {
+    return run(true, sequence, data, length, aad, aadLength, tag);
+}
+
+bool Cipher::openAt(quint64 sequence, char *data, int length, const char *aad, int aadLength, const char *tag) {
+    return run(false, sequence, data, length, aad, aadLength, const_cast<char *>(tag));
+}
+
+bool Cipher::run(bool encrypt, quint64 sequence, char *data, int length, const char *aad, int aadLength, char *tag) {
+#ifdef NWT_SESSION_CRYPTO
+    if (!m_ctx) {
+        return false;
+    }
+    EVP_CIPHER_CTX *ctx = m_ctx.get();
+    unsigned char nonce[GcmNonceSize];
+    std::memcpy(nonce, m_salt.constData(), SaltSize);
+    qToBigEndian<quint64>(sequence, nonce + SaltSize);
+    auto *bytes = reinterpret_cast<unsigned char *>(data);
+    int written = 0;
+    if (EVP_CipherInit_ex(ctx, nullptr, nullptr, nullptr, nonce, encrypt ? 1 : 0) != 1) {
+        return false;
+    }
+    if (aadLength > 0 &&
+        EVP_CipherUpdate(ctx, nullptr, &written, reinterpret_cast<const unsigned char *>(aad), aadLength) != 1) {
+        return false;
+    }
+    if (length > 0 && EVP_CipherUpdate(ctx, bytes, &written, bytes, length) != 1) {
+        return false;
+    }
+    if (!encrypt && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, TagSize, tag) != 1) {
+        return false;
+    }
+    // GCM 不产生额外输出，Final 在解密时负责校验认证标签。
+    unsigned char tail[16];
+    if (EVP_CipherFinal_ex(ctx, tail, &written) != 1) {
+        return false;
+    }
+    return !encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, TagSize, tag) == 1;
+#else
+    Q_UNUSED(encrypt);
+    Q_UNUSED(sequence);
+    Q_UNUSED(data);
+    Q_UNUSED(length);
+    Q_UNUSED(aad);
+    Q_UNUSED(aadLength);
+    Q_UNUSED(tag);
+    return false;
+#endif
+}
+} // namespace SessionCrypto
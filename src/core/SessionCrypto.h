@@ -0,0 +1,85 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+#include <memory>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+/*!
+ * \brief 路由会话加密：X25519 密钥交换、HKDF-SHA256 派生会话密钥、AES-256-GCM 认证加密以及无状态会话票据。
+ *
+ * 仅在以 NWT_ENABLE_SESSION_CRYPTO 构建并链接 OpenSSL 时可用，否则 available() 返回 false，路由继续使用明文会话。
+ * 密钥交换不校验对端身份，防护的是局域网内的被动窃听和对帧内容的篡改，不能抵御主动的中间人。
+ * 已知对端支持加密时路由拒绝明文帧，丢弃握手报文不能使会话降级为明文；对端能力来自未经认证的发现报文，
+ * 能伪造发现报文的攻击者仍可降级。
+ */
+namespace SessionCrypto {
+constexpr int KeySize = 32;
+constexpr int SaltSize = 4;
+constexpr int TagSize = 16;
+constexpr int NonceSize = 16;
+constexpr int PublicKeySize = 32;
+// 会话票据的有效期，过期后重连需要重新做完整的密钥交换。
+constexpr qint64 TicketLifetimeSecs = 12 * 3600;
+
+bool available();
+QByteArray randomBytes(int size);
+
+bool generateKeyPair(QByteArray *privateKey, QByteArray *publicKey);
+/*!
+ * \brief sharedSecret 计算 X25519 共享密钥，对端公钥无效时返回空。
+ */
+QByteArray sharedSecret(const QByteArray &privateKey, const QByteArray &peerPublicKey);
+
+/*!
+ * \brief 一次握手派生出的密钥材料：客户端（发起方）与服务端各自的发送密钥和 nonce 前缀，以及供下次恢复使用的秘密。
+ */
+struct SessionKeys {
+    QByteArray clientKey;
+    QByteArray clientSalt;
+    QByteArray serverKey;
+    QByteArray serverSalt;
+    QByteArray resumeSecret;
+};
+
+/*!
+ * \brief deriveSessionKeys 以 HKDF-SHA256 从共享秘密派生会话密钥，双方的握手随机数作为盐，保证每条连接的密钥不同。
+ */
+bool deriveSessionKeys(const QByteArray &secret, const QByteArray &clientNonce, const QByteArray &serverNonce,
+                       SessionKeys *keys);
+
+/*!
+ * \brief issueTicket 用进程内随机生成的票据密钥加密恢复秘密，票据由客户端保存，服务端无需保留任何会话状态。
+ */
+QByteArray issueTicket(const QByteArray &resumeSecret, const QString &peerId);
+/*!
+ * \brief redeemTicket 校验票据归属与有效期并取回恢复秘密；本进程重启后旧票据自然失效。
+ */
+bool redeemTicket(const QByteArray &ticket, const QString &peerId, QByteArray *resumeSecret);
+
+/*!
+ * \brief Cipher 单向的 AES-256-GCM 加解密上下文。
+ *
+ * nonce 由 4 字节前缀与 8 字节递增序号组成，序号随每帧隐式递增：TCP 保证收发顺序一致，无需在帧内携带。
+ * 加解密均在调用方提供的缓冲区内原地进行。
+ */
+class Cipher {
+public:
+    bool init(const QByteArray &key, const QByteArray &salt);
+    bool isValid() const { return static_cast<bool>(m_ctx); }
+    bool seal(char *data, int length, const char *aad, int aadLength, char *tag);
+    bool open(char *data, int length, const char *aad, int aadLength, const char *tag);
+    bool sealAt(quint64 sequence, char *data, int length, const char *aad, int aadLength, char *tag);
+    bool openAt(quint64 sequence, char *data, int length, const char *aad, int aadLength, const char *tag);
+
+private:
+    bool run(bool encrypt, quint64 sequence, char *data, int length, const char *aad, int aadLength, char *tag);
+
+    std::shared_ptr<EVP_CIPHER_CTX> m_ctx;
+    QByteArray m_salt;
+    quint64 m_sequence = 0;
+};
+} // namespace SessionCrypto
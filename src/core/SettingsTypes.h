@@ -68,6 +68,13 @@ struct NetworkSettings {
     bool restrictToListedSubnets = false;
     bool autoRefresh = true;
     int refreshIntervalMinutes = 5;
+    // 组播发现：网卡取 boundInterfaceId（未绑定时为全部可组播网卡），TTL 大于 1 时可经组播路由跨越 VLAN。
+    bool multicastDiscovery = false;
+    QString multicastGroup = QStringLiteral("239.255.77.77");
+    int multicastTtl = 4;
+    // 连接池：同时保持的会话上限，以及空闲会话在多久后关闭（秒），下次发送时自动重建。
+    int maxSessions = 256;
+    int sessionIdleTimeoutSeconds = 600;
 };
 
 /*!
@@ -46,6 +46,20 @@ QList<SharedFileInfo> ShareManager::remoteCatalog(const QString &peerId) const {
 }
 
 QString ShareManager::saveIncomingFile(const QString &fileName, const QByteArray &data, QString *errorString) const {
+    const QString targetPath = reserveIncomingPath(fileName);
+    QFile file(targetPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) {
+            *errorString = file.errorString();
+        }
+        return {};
+    }
+    file.write(data);
+    file.close();
+    return targetPath;
+}
+
+QString ShareManager::downloadDirectory() {
     QString baseDir = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
     if (baseDir.isEmpty()) {
         baseDir = QDir(QCoreApplication::applicationDirPath()).filePath(QStringLiteral("downloads"));
@@ -55,14 +69,24 @@ QString ShareManager::saveIncomingFile(const QString &fileName, const QByteArray
     if (!dir.exists()) {
         dir.mkpath(QStringLiteral("."));
     }
+    return dir.absolutePath();
+}
 
-    QString resolvedName = fileName;
+QString ShareManager::reserveIncomingPath(const QString &fileName) {
+    // 远端提供的文件名只保留最后一段，避免写出下载目录。
+    QString safeName = QFileInfo(fileName).fileName();
+    if (safeName.isEmpty()) {
+        safeName = QStringLiteral("download");
+    }
+
+    const QDir dir(downloadDirectory());
+    const QFileInfo info(safeName);
+    const QString base = info.completeBaseName();
+    const QString ext = info.suffix();
+    QString resolvedName = safeName;
     QString targetPath = dir.filePath(resolvedName);
     int suffix = 1;
-    while (QFile::exists(targetPath)) {
-        const QFileInfo info(fileName);
-        const QString base = info.completeBaseName();
-        const QString ext = info.suffix();
+    while (QFile::exists(targetPath) || QFile::exists(targetPath + QStringLiteral(".part"))) {
         if (ext.isEmpty()) {
             resolvedName = QStringLiteral("%1_%2").arg(base).arg(suffix++);
         } else {
@@ -70,16 +94,6 @@ QString ShareManager::saveIncomingFile(const QString &fileName, const QByteArray
         }
         targetPath = dir.filePath(resolvedName);
     }
-
-    QFile file(targetPath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        if (errorString) {
-            *errorString = file.errorString();
-        }
-        return {};
-    }
-    file.write(data);
-    file.close();
     return targetPath;
 }
 
@@ -22,6 +22,15 @@ public:
 
     QString saveIncomingFile(const QString &fileName, const QByteArray &data, QString *errorString = nullptr) const;
 
+    /*!
+     * \brief downloadDirectory 返回接收文件的保存目录，不存在时自动创建。
+     */
+    static QString downloadDirectory();
+    /*!
+     * \brief reserveIncomingPath 为远端文件名生成不与已有文件（含未完成的 .part 文件）冲突的本地路径。
+     */
+    static QString reserveIncomingPath(const QString &fileName);
+
 private:
     QString buildShareEntryId(const QString &filePath) const;
 
@@ -14,3 +14,38 @@ struct SharedFileInfo {
     QString filePath;
 };
 Q_DECLARE_METATYPE(SharedFileInfo)
+
+/*!
+ * \brief 单个文件传输的进度快照，供界面绑定传输进度与结果。
+ */
+struct FileTransferStatus {
+    QString transferId;
+    QString peerId;
+    QString fileName;
+    QString localPath;
+    QString roleName;
+    quint64 totalBytes = 0;
+    quint64 transferredBytes = 0;
+    bool outgoing = true;
+};
+Q_DECLARE_METATYPE(FileTransferStatus)
+
+/*!
+ * \brief 可续传文件传输的持久化检查点。
+ *
+ * 发送端的 localPath 为源文件路径，接收端为最终保存路径（未完成数据位于同名 .part 文件）。
+ * committedOffset 为已确认落盘的字节数，续传时从该偏移继续。
+ */
+struct TransferCheckpoint {
+    QString transferId;
+    QString peerId;
+    bool outgoing = true;
+    QString fileName;
+    QString localPath;
+    QString contentHash;
+    QString roleId;
+    QString roleName;
+    quint64 totalSize = 0;
+    quint64 committedOffset = 0;
+};
+Q_DECLARE_METATYPE(TransferCheckpoint)
@@ -156,6 +156,23 @@ PersistedState StorageManager::loadState() const {
             if (refreshInterval > 0) {
                 network.refreshIntervalMinutes = refreshInterval;
             }
+            network.multicastDiscovery = intToBool(query.value(QStringLiteral("multicast_discovery")).toInt());
+            const QString multicastGroup = query.value(QStringLiteral("multicast_group")).toString();
+            if (!multicastGroup.isEmpty()) {
+                network.multicastGroup = multicastGroup;
+            }
+            const int multicastTtl = query.value(QStringLiteral("multicast_ttl")).toInt();
+            if (multicastTtl > 0 && multicastTtl <= 255) {
+                network.multicastTtl = multicastTtl;
+            }
+            const int maxSessions = query.value(QStringLiteral("max_sessions")).toInt();
+            if (maxSessions > 0) {
+                network.maxSessions = maxSessions;
+            }
+            const int idleTimeout = query.value(QStringLiteral("session_idle_timeout")).toInt();
+            if (idleTimeout > 0) {
+                network.sessionIdleTimeoutSeconds = idleTimeout;
+            }
         }
     }
 
@@ -348,7 +365,7 @@ QVector<StoredMessage> StorageManager::recentMessages(const QString &peerId, int
     }
     QSqlQuery query(db);
     query.prepare(QStringLiteral("SELECT id, role_name, message_type, content, attachment_path, outgoing, created_at "
-                                 "FROM chat_messages WHERE peer_id = ? ORDER BY created_at DESC LIMIT ?"));
+                                 "FROM chat_messages WHERE peer_id = ? ORDER BY created_at DESC, id DESC LIMIT ?"));
     query.addBindValue(peerId);
     query.addBindValue(limit);
     if (query.exec()) {
@@ -417,6 +434,25 @@ void StorageManager::upsertKnownPeer(const PeerInfo &peer) {
     query.exec();
 }
 
+void StorageManager::touchKnownPeers(const QHash<QString, qint64> &lastSeen) {
+    if (!m_initialized || lastSeen.isEmpty()) {
+        return;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return;
+    }
+    db.transaction();
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("UPDATE known_peers SET last_seen = ? WHERE peer_id = ?"));
+    for (auto it = lastSeen.cbegin(); it != lastSeen.cend(); ++it) {
+        query.addBindValue(it.value());
+        query.addBindValue(it.key());
+        query.exec();
+    }
+    db.commit();
+}
+
 QList<PeerInfo> StorageManager::knownPeers() const {
     QList<PeerInfo> list;
     if (!m_initialized) {
@@ -452,6 +488,237 @@ QList<PeerInfo> StorageManager::knownPeers() const {
     return list;
 }
 
+void StorageManager::upsertTransfer(const TransferCheckpoint &checkpoint) {
+    if (!m_initialized || checkpoint.transferId.isEmpty()) {
+        return;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("REPLACE INTO file_transfers(transfer_id, peer_id, outgoing, file_name, local_path,"
+                                 " content_hash, role_id, role_name, total_size, committed_offset, updated_at)"
+                                 " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"));
+    query.addBindValue(checkpoint.transferId);
+    query.addBindValue(checkpoint.peerId);
+    query.addBindValue(boolToInt(checkpoint.outgoing));
+    query.addBindValue(checkpoint.fileName);
+    query.addBindValue(checkpoint.localPath);
+    query.addBindValue(checkpoint.contentHash);
+    query.addBindValue(checkpoint.roleId);
+    query.addBindValue(checkpoint.roleName);
+    query.addBindValue(static_cast<qint64>(checkpoint.totalSize));
+    query.addBindValue(static_cast<qint64>(checkpoint.committedOffset));
+    query.addBindValue(QDateTime::currentSecsSinceEpoch());
+    query.exec();
+}
+
+void StorageManager::removeTransfer(const QString &transferId) {
+    if (!m_initialized || transferId.isEmpty()) {
+        return;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("DELETE FROM file_transfers WHERE transfer_id = ?"));
+    query.addBindValue(transferId);
+    query.exec();
+}
+
+QVector<TransferCheckpoint> StorageManager::pendingTransfers(const QString &peerId) const {
+    QVector<TransferCheckpoint> transfers;
+    if (!m_initialized) {
+        return transfers;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return transfers;
+    }
+    QSqlQuery query(db);
+    QString sql = QStringLiteral("SELECT transfer_id, peer_id, outgoing, file_name, local_path, content_hash, role_id,"
+                                 " role_name, total_size, committed_offset FROM file_transfers");
+    if (!peerId.isEmpty()) {
+        sql += QStringLiteral(" WHERE peer_id = ?");
+    }
+    sql += QStringLiteral(" ORDER BY updated_at ASC");
+    query.prepare(sql);
+    if (!peerId.isEmpty()) {
+        query.addBindValue(peerId);
+    }
+    if (!query.exec()) {
+        return transfers;
+    }
+    while (query.next()) {
+        TransferCheckpoint checkpoint;
+        checkpoint.transferId = query.value(0).toString();
+        checkpoint.peerId = query.value(1).toString();
+        checkpoint.outgoing = intToBool(query.value(2).toInt());
+        checkpoint.fileName = query.value(3).toString();
+        checkpoint.localPath = query.value(4).toString();
+        checkpoint.contentHash = query.value(5).toString();
+        checkpoint.roleId = query.value(6).toString();
+        checkpoint.roleName = query.value(7).toString();
+        checkpoint.totalSize = static_cast<quint64>(query.value(8).toLongLong());
+        checkpoint.committedOffset = static_cast<quint64>(query.value(9).toLongLong());
+        transfers.append(checkpoint);
+    }
+    return transfers;
+}
+
+void StorageManager::enqueueOutbox(const OutboxMessage &message, qint64 attemptedAt) {
+    if (!m_initialized || message.messageId.isEmpty()) {
+        return;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("INSERT OR IGNORE INTO chat_outbox(message_id, peer_id, role_name, content,"
+                                 " created_at, attempted_at) VALUES (?, ?, ?, ?, ?, ?)"));
+    query.addBindValue(message.messageId);
+    query.addBindValue(message.peerId);
+    query.addBindValue(message.roleName);
+    query.addBindValue(message.text);
+    query.addBindValue(message.createdAt);
+    query.addBindValue(attemptedAt);
+    query.exec();
+}
+
+void StorageManager::removeOutbox(const QString &peerId, const QString &messageId) {
+    if (!m_initialized || peerId.isEmpty() || messageId.isEmpty()) {
+        return;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("DELETE FROM chat_outbox WHERE message_id = ? AND peer_id = ?"));
+    query.addBindValue(messageId);
+    query.addBindValue(peerId);
+    query.exec();
+}
+
+void StorageManager::markOutboxAttempted(const QStringList &messageIds, qint64 attemptedAt) {
+    if (!m_initialized || messageIds.isEmpty()) {
+        return;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return;
+    }
+    db.transaction();
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("UPDATE chat_outbox SET attempted_at = ? WHERE message_id = ?"));
+    for (const QString &messageId : messageIds) {
+        query.addBindValue(attemptedAt);
+        query.addBindValue(messageId);
+        query.exec();
+    }
+    db.commit();
+}
+
+QVector<OutboxMessage> StorageManager::pendingOutbox(const QString &peerId, qint64 attemptedBefore, int limit) const {
+    QVector<OutboxMessage> messages;
+    if (!m_initialized || peerId.isEmpty() || limit <= 0) {
+        return messages;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return messages;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("SELECT message_id, role_name, content, created_at FROM chat_outbox"
+                                 " WHERE peer_id = ? AND attempted_at < ? ORDER BY seq ASC LIMIT ?"));
+    query.addBindValue(peerId);
+    query.addBindValue(attemptedBefore);
+    query.addBindValue(limit);
+    if (!query.exec()) {
+        return messages;
+    }
+    while (query.next()) {
+        OutboxMessage message;
+        message.messageId = query.value(0).toString();
+        message.peerId = peerId;
+        message.roleName = query.value(1).toString();
+        message.text = query.value(2).toString();
+        message.createdAt = query.value(3).toLongLong();
+        messages.append(message);
+    }
+    return messages;
+}
+
+QVector<QString> StorageManager::outboxPeerIds() const {
+    QVector<QString> peers;
+    if (!m_initialized) {
+        return peers;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return peers;
+    }
+    QSqlQuery query(db);
+    if (query.exec(QStringLiteral("SELECT DISTINCT peer_id FROM chat_outbox"))) {
+        while (query.next()) {
+            peers.append(query.value(0).toString());
+        }
+    }
+    return peers;
+}
+
+qint64 StorageManager::earliestOutboxAttempt(const QString &peerId) const {
+    if (!m_initialized || peerId.isEmpty()) {
+        return -1;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return -1;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("SELECT MIN(attempted_at) FROM chat_outbox WHERE peer_id = ?"));
+    query.addBindValue(peerId);
+    if (!query.exec() || !query.next() || query.value(0).isNull()) {
+        return -1;
+    }
+    return query.value(0).toLongLong();
+}
+
+bool StorageManager::recordReceivedMessage(const QString &peerId, const QString &messageId) {
+    if (!m_initialized || messageId.isEmpty()) {
+        return true;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return true;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("INSERT OR IGNORE INTO received_messages(peer_id, message_id, received_at)"
+                                 " VALUES (?, ?, ?)"));
+    query.addBindValue(peerId);
+    query.addBindValue(messageId);
+    query.addBindValue(QDateTime::currentSecsSinceEpoch());
+    // 写入失败时按首次收到处理，宁可重复显示也不丢消息。
+    return !query.exec() || query.numRowsAffected() > 0;
+}
+
+void StorageManager::pruneReceivedMessages(qint64 olderThan) {
+    if (!m_initialized) {
+        return;
+    }
+    QSqlDatabase db = connection();
+    if (!db.isValid()) {
+        return;
+    }
+    QSqlQuery query(db);
+    query.prepare(QStringLiteral("DELETE FROM received_messages WHERE received_at < ?"));
+    query.addBindValue(olderThan);
+    query.exec();
+}
+
 QSqlDatabase StorageManager::connection() const {
     return QSqlDatabase::database(m_connectionName);
 }
@@ -500,9 +767,26 @@ void StorageManager::ensureSchema(QSqlDatabase &db) const {
         interface_id TEXT,\
         restrict_listed INTEGER NOT NULL DEFAULT 0,\
         auto_refresh INTEGER NOT NULL DEFAULT 1,\
-        refresh_interval INTEGER NOT NULL DEFAULT 5\
+        refresh_interval INTEGER NOT NULL DEFAULT 5,\
+        multicast_discovery INTEGER NOT NULL DEFAULT 0,\
+        multicast_group TEXT,\
+        multicast_ttl INTEGER NOT NULL DEFAULT 4,\
+        max_sessions INTEGER NOT NULL DEFAULT 256,\
+        session_idle_timeout INTEGER NOT NULL DEFAULT 600\
     )"));
 
+    QSqlRecord networkRecord = db.record(QStringLiteral("network_settings"));
+    if (networkRecord.indexOf(QStringLiteral("multicast_discovery")) == -1) {
+        query.exec(QStringLiteral("ALTER TABLE network_settings ADD COLUMN multicast_discovery INTEGER NOT NULL DEFAULT 0"));
+        query.exec(QStringLiteral("ALTER TABLE network_settings ADD COLUMN multicast_group TEXT"));
+        query.exec(QStringLiteral("ALTER TABLE network_settings ADD COLUMN multicast_ttl INTEGER NOT NULL DEFAULT 4"));
+    }
+    if (networkRecord.indexOf(QStringLiteral("max_sessions")) == -1) {
+        query.exec(QStringLiteral("ALTER TABLE network_settings ADD COLUMN max_sessions INTEGER NOT NULL DEFAULT 256"));
+        query.exec(
+            QStringLiteral("ALTER TABLE network_settings ADD COLUMN session_idle_timeout INTEGER NOT NULL DEFAULT 600"));
+    }
+
     query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS notification_settings (\
         id INTEGER PRIMARY KEY CHECK(id = 1),\
         notify_self_online INTEGER NOT NULL DEFAULT 0,\
@@ -595,6 +879,41 @@ void StorageManager::ensureSchema(QSqlDatabase &db) const {
         last_seen INTEGER,\
         capabilities TEXT\
     )"));
+
+    query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS file_transfers (\
+        transfer_id TEXT PRIMARY KEY,\
+        peer_id TEXT NOT NULL,\
+        outgoing INTEGER NOT NULL,\
+        file_name TEXT NOT NULL,\
+        local_path TEXT NOT NULL,\
+        content_hash TEXT NOT NULL,\
+        role_id TEXT,\
+        role_name TEXT,\
+        total_size INTEGER NOT NULL,\
+        committed_offset INTEGER NOT NULL DEFAULT 0,\
+        updated_at INTEGER NOT NULL\
+    )"));
+    query.exec(QStringLiteral("CREATE INDEX IF NOT EXISTS idx_file_transfers_peer ON file_transfers(peer_id)"));
+
+    query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS chat_outbox (\
+        seq INTEGER PRIMARY KEY AUTOINCREMENT,\
+        message_id TEXT NOT NULL UNIQUE,\
+        peer_id TEXT NOT NULL,\
+        role_name TEXT,\
+        content TEXT NOT NULL,\
+        created_at INTEGER NOT NULL,\
+        attempted_at INTEGER NOT NULL DEFAULT 0\
+    )"));
+    query.exec(QStringLiteral("CREATE INDEX IF NOT EXISTS idx_chat_outbox_peer ON chat_outbox(peer_id, seq)"));
+    // created_at 早期以秒保存，改为毫秒以保留消息时间戳的精度；毫秒值远大于该阈值，重复执行不受影响。
+    query.exec(QStringLiteral("UPDATE chat_outbox SET created_at = created_at * 1000 WHERE created_at < 100000000000"));
+
+    query.exec(QStringLiteral("CREATE TABLE IF NOT EXISTS received_messages (\
+        peer_id TEXT NOT NULL,\
+        message_id TEXT NOT NULL,\
+        received_at INTEGER NOT NULL,\
+        PRIMARY KEY (peer_id, message_id)\
+    )"));
 }
 
 void StorageManager::writeGeneralSettings(const AppSettings &settings, QSqlDatabase &db) const {
@@ -626,7 +945,9 @@ void StorageManager::writeNetworkSettings(const AppSettings &settings, QSqlDatab
     const NetworkSettings &network = settings.network;
     query.prepare(QStringLiteral("REPLACE INTO network_settings(id, search_port, organization_code, enable_interop,"
                                  " interop_port, bind_interface, interface_id, restrict_listed, auto_refresh,"
-                                 " refresh_interval) VALUES (1, ?, ?, ?, ?, ?, ?, ?, ?, ?)"));
+                                 " refresh_interval, multicast_discovery, multicast_group, multicast_ttl,"
+                                 " max_sessions, session_idle_timeout)"
+                                 " VALUES (1, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"));
     query.addBindValue(static_cast<int>(network.searchPort));
     query.addBindValue(network.organizationCode);
     query.addBindValue(boolToInt(network.enableInterop));
@@ -636,6 +957,11 @@ void StorageManager::writeNetworkSettings(const AppSettings &settings, QSqlDatab
     query.addBindValue(boolToInt(network.restrictToListedSubnets));
     query.addBindValue(boolToInt(network.autoRefresh));
     query.addBindValue(network.refreshIntervalMinutes);
+    query.addBindValue(boolToInt(network.multicastDiscovery));
+    query.addBindValue(network.multicastGroup);
+    query.addBindValue(network.multicastTtl);
+    query.addBindValue(network.maxSessions);
+    query.addBindValue(network.sessionIdleTimeoutSeconds);
     query.exec();
 }
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "SettingsTypes.h"
+#include "ShareTypes.h"
 
+#include <QHash>
 #include <QHostAddress>
 #include <QList>
 #include <QPair>
@@ -42,6 +44,18 @@ struct StoredMessage {
     qint64 timestamp = 0;
 };
 
+/*!
+ * \brief 待投递的聊天消息：对端确认收到前保留在发件箱中，联系人重新上线后重发。
+ */
+struct OutboxMessage {
+    QString messageId;
+    QString peerId;
+    QString roleName;
+    QString text;
+    // 创建时间（UTC 毫秒），重发时作为消息的原始时间戳。
+    qint64 createdAt = 0;
+};
+
 /*!
  * \brief 管理聊天应用的SQLite数据库，负责配置与消息记录持久化。
  */
@@ -70,12 +84,66 @@ public:
      * \param peer 当前发现到的联系人信息
      */
     void upsertKnownPeer(const PeerInfo &peer);
+    /*!
+     * \brief touchKnownPeers 在一个事务中批量更新已知联系人的最近出现时间。
+     * \param lastSeen 联系人 ID 到最近出现时间（秒级时间戳）的映射
+     */
+    void touchKnownPeers(const QHash<QString, qint64> &lastSeen);
     /*!
      * \brief knownPeers 读取历史上发现过的联系人列表。
      * \return 已持久化的联系人集合
      */
     QList<PeerInfo> knownPeers() const;
 
+    /*!
+     * \brief upsertTransfer 写入或更新文件传输检查点。
+     */
+    void upsertTransfer(const TransferCheckpoint &checkpoint);
+    /*!
+     * \brief removeTransfer 删除已完成或已放弃的传输检查点。
+     */
+    void removeTransfer(const QString &transferId);
+    /*!
+     * \brief pendingTransfers 读取尚未完成的传输检查点。
+     * \param peerId 非空时只返回该联系人的传输
+     */
+    QVector<TransferCheckpoint> pendingTransfers(const QString &peerId = QString()) const;
+
+    /*!
+     * \brief enqueueOutbox 将消息写入发件箱，收到对端确认后由 removeOutbox 删除。
+     * \param attemptedAt 最近一次发送时间（秒），尚未发送时为 0
+     */
+    void enqueueOutbox(const OutboxMessage &message, qint64 attemptedAt);
+    /*!
+     * \brief removeOutbox 删除发往 peerId 的指定消息；确认来自其他联系人时不做任何修改。
+     */
+    void removeOutbox(const QString &peerId, const QString &messageId);
+    /*!
+     * \brief markOutboxAttempted 记录一批消息的发送时间，重发时据此跳过刚发出、确认尚在途中的消息。
+     */
+    void markOutboxAttempted(const QStringList &messageIds, qint64 attemptedAt);
+    /*!
+     * \brief pendingOutbox 按入队顺序读取发往联系人、且最近发送早于 attemptedBefore 的待确认消息。
+     */
+    QVector<OutboxMessage> pendingOutbox(const QString &peerId, qint64 attemptedBefore, int limit) const;
+    /*!
+     * \brief outboxPeerIds 返回发件箱中仍有待确认消息的联系人。
+     */
+    QVector<QString> outboxPeerIds() const;
+    /*!
+     * \brief earliestOutboxAttempt 发往联系人的待确认消息中最早的发送时间（秒），发件箱为空时返回 -1。
+     */
+    qint64 earliestOutboxAttempt(const QString &peerId) const;
+    /*!
+     * \brief recordReceivedMessage 登记收到的消息 ID，用于接收端去重。
+     * \return 首次收到时返回 true；已收到过（对端重发）时返回 false
+     */
+    bool recordReceivedMessage(const QString &peerId, const QString &messageId);
+    /*!
+     * \brief pruneReceivedMessages 清理早于 olderThan（秒）的去重记录。
+     */
+    void pruneReceivedMessages(qint64 olderThan);
+
 private:
     QSqlDatabase connection() const;
     void ensureSchema(QSqlDatabase &db) const;
@@ -0,0 +1,215 @@
+#include "WireProtocol.h"
+
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+namespace WireProtocol {
+
+QByteArray encodeFrame(FrameType type, quint16 flags, const QByteArray &payload, int trailer) {
+    FrameHeader header;
+    header.type = type;
+    header.flags = flags;
+    header.length = static_cast<quint32>(payload.size() + trailer);
+
+    QByteArray frame;
+    frame.resize(HeaderSize + payload.size() + trailer);
+    writeHeader(frame.data(), header);
+    if (!payload.isEmpty()) {
+        std::memcpy(frame.data() + HeaderSize, payload.constData(), static_cast<size_t>(payload.size()));
+    }
+    return frame;
+}
+
+QByteArray encodeRegionHeader(const QString &transferId, quint64 offset, quint32 dataLength) {
+    const QByteArray id = transferId.toUtf8().left(255);
+    const int subHeaderSize = 1 + id.size() + 8;
+    FrameHeader header;
+    header.type = FrameType::FileRegion;
+    header.length = static_cast<quint32>(subHeaderSize) + dataLength;
+
+    QByteArray out;
+    out.resize(HeaderSize + subHeaderSize);
+    char *cursor = out.data();
+    writeHeader(cursor, header);
+    cursor += HeaderSize;
+    *cursor++ = static_cast<char>(id.size());
+    std::memcpy(cursor, id.constData(), static_cast<size_t>(id.size()));
+    cursor += id.size();
+    qToBigEndian<quint64>(offset, cursor);
+    return out;
+}
+
+bool decodeRegion(const QByteArray &payload, QString *transferId, quint64 *offset, QByteArray *data) {
+    if (payload.isEmpty()) {
+        return false;
+    }
+    const int idLength = static_cast<uchar>(payload.at(0));
+    const int dataStart = 1 + idLength + 8;
+    if (payload.size() < dataStart) {
+        return false;
+    }
+    *transferId = QString::fromUtf8(payload.constData() + 1, idLength);
+    *offset = qFromBigEndian<quint64>(payload.constData() + 1 + idLength);
+    *data = payload.mid(dataStart);
+    return true;
+}
+
+bool isLikelyCompressible(const QByteArray &payload) {
+    // 在负载的四个位置各取 1KB 统计字节分布，避免对整个大块做完整扫描。
+    constexpr int SampleBlocks = 4;
+    constexpr int SampleBlockSize = 1024;
+    constexpr double EntropyLimit = 7.5;
+    int histogram[256] = {};
+    int sampled = 0;
+    const int size = payload.size();
+    const auto *data = reinterpret_cast<const uchar *>(payload.constData());
+    for (int block = 0; block < SampleBlocks; ++block) {
+        const int start = static_cast<int>(static_cast<qint64>(size) * block / SampleBlocks);
+        const int end = qMin(size, start + SampleBlockSize);
+        for (int i = start; i < end; ++i) {
+            ++histogram[data[i]];
+        }
+        sampled += qMax(0, end - start);
+    }
+    if (sampled == 0) {
+        return false;
+    }
+    double entropy = 0.0;
+    for (const int count : histogram) {
+        if (count > 0) {
+            const double p = static_cast<double>(count) / sampled;
+            entropy -= p * std::log2(p);
+        }
+    }
+    return entropy < EntropyLimit;
+}
+
+bool compressPayload(const QByteArray &payload, QByteArray *compressed) {
+    if (payload.size() < CompressionThreshold || !isLikelyCompressible(payload)) {
+        return false;
+    }
+    // 低压缩级别足以处理文本与 JSON，CPU 开销远小于默认级别。
+    QByteArray result = qCompress(payload, 1);
+    // 节省不足八分之一时按原样发送，接收端也省去解压。
+    if (result.isEmpty() || result.size() > payload.size() - payload.size() / 8) {
+        return false;
+    }
+    *compressed = result;
+    return true;
+}
+
+bool decompressPayload(const QByteArray &payload, QByteArray *decompressed) {
+    if (payload.size() < 4 || qFromBigEndian<quint32>(payload.constData()) > MaxPayloadSize) {
+        return false;
+    }
+    *decompressed = qUncompress(payload);
+    return !decompressed->isEmpty();
+}
+
+void writeHeader(char *out, const FrameHeader &header) {
+    qToBigEndian<quint32>(FrameMagic, out);
+    out[4] = static_cast<char>(header.version);
+    out[5] = static_cast<char>(header.type);
+    qToBigEndian<quint16>(header.flags, out + 6);
+    qToBigEndian<quint32>(header.length, out + 8);
+}
+
+bool readHeader(const char *data, FrameHeader *header) {
+    if (qFromBigEndian<quint32>(data) != FrameMagic) {
+        return false;
+    }
+    header->version = static_cast<quint8>(data[4]);
+    header->type = static_cast<FrameType>(static_cast<quint8>(data[5]));
+    header->flags = qFromBigEndian<quint16>(data + 6);
+    header->length = qFromBigEndian<quint32>(data + 8);
+    return header->version == FrameVersion && header->length <= MaxPayloadSize;
+}
+
+void FrameDecoder::append(const QByteArray &data) {
+    if (m_error || data.isEmpty()) {
+        return;
+    }
+    m_buffer.append(data);
+    if (m_mode == Mode::Detecting) {
+        const char magicLead = static_cast<char>((FrameMagic >> 24) & 0xFF);
+        m_mode = m_buffer.at(m_readPos) == magicLead ? Mode::Frames : Mode::JsonLines;
+    }
+}
+
+bool FrameDecoder::next(Frame *frame) {
+    if (m_error || !frame) {
+        return false;
+    }
+    bool produced = false;
+    switch (m_mode) {
+    case Mode::JsonLines:
+        produced = nextLine(frame);
+        break;
+    case Mode::Frames:
+        produced = nextFrame(frame);
+        break;
+    case Mode::Detecting:
+        break;
+    }
+    if (!produced) {
+        compact();
+    }
+    return produced;
+}
+
+bool FrameDecoder::nextLine(Frame *frame) {
+    // m_scanPos 记录已确认不含换行的位置，半包到达时不会重复扫描旧数据。
+    const int newline = m_buffer.indexOf('\n', qMax(m_readPos, m_scanPos));
+    if (newline < 0) {
+        m_scanPos = m_buffer.size();
+        return false;
+    }
+    frame->type = FrameType::Json;
+    frame->flags = NoFlags;
+    frame->payload = QByteArray(m_buffer.constData() + m_readPos, newline - m_readPos);
+    m_readPos = newline + 1;
+    m_scanPos = m_readPos;
+    return true;
+}
+
+bool FrameDecoder::nextFrame(Frame *frame) {
+    const int available = m_buffer.size() - m_readPos;
+    if (available < HeaderSize) {
+        return false;
+    }
+    FrameHeader header;
+    if (!readHeader(m_buffer.constData() + m_readPos, &header)) {
+        m_error = true;
+        return false;
+    }
+    const qint64 frameSize = static_cast<qint64>(HeaderSize) + header.length;
+    if (available < frameSize) {
+        // 预留整帧空间，避免大帧在多次 readyRead 之间反复扩容。
+        m_buffer.reserve(m_readPos + static_cast<int>(frameSize));
+        return false;
+    }
+    frame->type = header.type;
+    frame->flags = header.flags;
+    frame->payload = QByteArray(m_buffer.constData() + m_readPos + HeaderSize, static_cast<int>(header.length));
+    m_readPos += static_cast<int>(frameSize);
+    return true;
+}
+
+void FrameDecoder::compact() {
+    if (m_readPos == 0) {
+        return;
+    }
+    if (m_readPos >= m_buffer.size()) {
+        m_buffer.clear();
+        m_readPos = 0;
+        m_scanPos = 0;
+        return;
+    }
+    if (m_readPos * 2 >= m_buffer.size()) {
+        m_buffer.remove(0, m_readPos);
+        m_scanPos = qMax(0, m_scanPos - m_readPos);
+        m_readPos = 0;
+    }
+}
+} // namespace WireProtocol
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/*!
+ * \brief 路由层 TCP 线路协议：定长帧头 + 负载的二进制分帧格式，并兼容旧版按行分隔的 JSON。
+ *
+ * 帧头布局（网络字节序，共 12 字节）：
+ *   magic(4) | version(1) | type(1) | flags(2) | length(4)
+ */
+namespace WireProtocol {
+constexpr quint32 FrameMagic = 0x4E575446u; // "NWTF"
+constexpr quint8 FrameVersion = 1;
+constexpr int HeaderSize = 12;
+constexpr quint32 MaxPayloadSize = 64u * 1024u * 1024u;
+
+/*!
+ * \brief 帧负载类型。
+ */
+enum class FrameType : quint8 {
+    Json = 1,
+    Cbor = 2,
+    FileRegion = 3 // 文件数据块：紧凑的二进制子头后直接跟随原始文件内容
+};
+
+/*!
+ * \brief 帧头标志位。
+ */
+enum FrameFlag : quint16 {
+    NoFlags = 0,
+    Compressed = 0x0001, // 负载经 qCompress（zlib）压缩
+    Sealed = 0x0002      // 负载经会话密钥加密，末尾附 16 字节认证标签；先压缩后加密
+};
+
+// 负载达到该大小才考虑压缩，更小的帧压缩收益抵不过开销。
+constexpr int CompressionThreshold = 1024;
+
+struct FrameHeader {
+    quint8 version = FrameVersion;
+    FrameType type = FrameType::Json;
+    quint16 flags = NoFlags;
+    quint32 length = 0;
+};
+
+/*!
+ * \brief 已解码的一帧；按行协议收到的 JSON 也以 Json 帧的形式交付。
+ */
+struct Frame {
+    FrameType type = FrameType::Json;
+    quint16 flags = NoFlags;
+    QByteArray payload;
+};
+
+/*!
+ * \brief encodeFrame 生成一帧；trailer 为负载之后预留的字节数（计入帧长度），供调用方原地写入认证标签。
+ */
+QByteArray encodeFrame(FrameType type, quint16 flags, const QByteArray &payload, int trailer = 0);
+
+/*!
+ * \brief encodeRegionHeader 生成 FileRegion 帧的帧头与子头，文件内容由调用方随后直接写出（可走 sendfile）。
+ *
+ * 子头布局：idLength(1) | transferId(UTF-8) | offset(8，网络字节序)
+ */
+QByteArray encodeRegionHeader(const QString &transferId, quint64 offset, quint32 dataLength);
+bool decodeRegion(const QByteArray &payload, QString *transferId, quint64 *offset, QByteArray *data);
+
+/*!
+ * \brief isLikelyCompressible 对负载做分段采样估算字节熵，已压缩的数据（zip、jpg、mp4 等）熵接近 8 bit/字节，直接判定为不可压缩。
+ */
+bool isLikelyCompressible(const QByteArray &payload);
+/*!
+ * \brief compressPayload 压缩负载；不值得压缩时返回 false，调用方按原样发送。
+ */
+bool compressPayload(const QByteArray &payload, QByteArray *compressed);
+/*!
+ * \brief decompressPayload 解压负载，声明的原始大小超过 MaxPayloadSize 时拒绝，防止压缩炸弹。
+ */
+bool decompressPayload(const QByteArray &payload, QByteArray *decompressed);
+void writeHeader(char *out, const FrameHeader &header);
+bool readHeader(const char *data, FrameHeader *header);
+
+/*!
+ * \brief FrameDecoder 以读游标消费接收缓冲区，避免每条消息都移动剩余数据。
+ *
+ * 首个字节决定连接模式：与帧魔数首字节一致时按帧解析，否则按换行分隔的 JSON 解析。
+ * 已消费数据仅在读游标越过缓冲区一半时才整体压缩，整体开销与接收字节数成线性关系。
+ */
+class FrameDecoder {
+public:
+    enum class Mode { Detecting, JsonLines, Frames };
+
+    void append(const QByteArray &data);
+    bool next(Frame *frame);
+    Mode mode() const { return m_mode; }
+    bool hasError() const { return m_error; }
+    int bufferedBytes() const { return m_buffer.size() - m_readPos; }
+
+private:
+    bool nextLine(Frame *frame);
+    bool nextFrame(Frame *frame);
+    void compact();
+
+    QByteArray m_buffer;
+    int m_readPos = 0;
+    int m_scanPos = 0;
+    Mode m_mode = Mode::Detecting;
+    bool m_error = false;
+};
+} // namespace WireProtocol
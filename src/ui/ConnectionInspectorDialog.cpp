@@ -0,0 +1,180 @@
+#include "ConnectionInspectorDialog.h"
+
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+namespace {
+constexpr int RefreshIntervalMs = 1000;
+
+QString formatBytes(quint64 bytes) {
+    return QLocale().formattedDataSize(static_cast<qint64>(bytes));
+}
+
+QString formatRate(double bytesPerSecond) {
+    return bytesPerSecond <= 0.0 ? QStringLiteral("-")
+                                 : QLocale().formattedDataSize(static_cast<qint64>(bytesPerSecond)) +
+                                       QStringLiteral("/s");
+}
+
+QString formatDuration(qint64 ms) {
+    const qint64 seconds = ms / 1000;
+    return QStringLiteral("%1:%2:%3")
+        .arg(seconds / 3600)
+        .arg(seconds / 60 % 60, 2, 10, QLatin1Char('0'))
+        .arg(seconds % 60, 2, 10, QLatin1Char('0'));
+}
+
+// 由直方图估算分位数，结果为所在桶的上限。
+QString latencyPercentile(const QVector<quint64> &histogram, double fraction) {
+    quint64 total = 0;
+    for (const quint64 count : histogram) {
+        total += count;
+    }
+    if (total == 0) {
+        return QStringLiteral("-");
+    }
+    const QVector<int> bounds = MessageRouter::latencyBucketBounds();
+    const quint64 target = static_cast<quint64>(static_cast<double>(total) * fraction + 0.5);
+    quint64 cumulative = 0;
+    for (int i = 0; i < histogram.size(); ++i) {
+        cumulative += histogram.at(i);
+        if (cumulative >= qMax<quint64>(target, 1)) {
+            return i < bounds.size() ? QStringLiteral("≤%1ms").arg(bounds.at(i))
+                                     : QStringLiteral(">%1ms").arg(bounds.constLast());
+        }
+    }
+    return QStringLiteral(">%1ms").arg(bounds.constLast());
+}
+} // namespace
+
+ConnectionInspectorDialog::ConnectionInspectorDialog(ChatController *controller, QWidget *parent)
+    : QDialog(parent), m_controller(controller) {
+    setWindowTitle(tr("连接诊断"));
+    resize(960, 420);
+
+    auto *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(20, 20, 20, 20);
+    layout->setSpacing(12);
+
+    m_summary = new QLabel(this);
+    layout->addWidget(m_summary);
+
+    const QStringList headers{tr("联系人"),   tr("通道"),     tr("地址"),     tr("连接时长"),
+                              tr("接收"),     tr("发送"),     tr("消息 收/发"), tr("待发送"),
+                              tr("接收速率"), tr("发送速率"), tr("重连"),     tr("确认延迟 P50/P95"),
+                              tr("往返时延"), tr("时钟偏差")};
+    m_table = new QTableWidget(0, headers.size(), this);
+    m_table->setHorizontalHeaderLabels(headers);
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_table->verticalHeader()->setVisible(false);
+    m_table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_table->horizontalHeader()->setStretchLastSection(true);
+    layout->addWidget(m_table, 1);
+
+    m_refreshTimer.setInterval(RefreshIntervalMs);
+    if (m_controller) {
+        connect(&m_refreshTimer, &QTimer::timeout, m_controller.data(), &ChatController::requestTransportStats);
+        connect(m_controller, &ChatController::transportStatsReady, this, &ConnectionInspectorDialog::updateStats);
+    }
+}
+
+void ConnectionInspectorDialog::showEvent(QShowEvent *event) {
+    QDialog::showEvent(event);
+    // 统计只在窗口可见时采集。
+    if (m_controller) {
+        m_controller->requestTransportStats();
+    }
+    m_refreshTimer.start();
+}
+
+void ConnectionInspectorDialog::hideEvent(QHideEvent *event) {
+    m_refreshTimer.stop();
+    QDialog::hideEvent(event);
+}
+
+void ConnectionInspectorDialog::updateStats(const QVector<MessageRouter::SessionStats> &stats,
+                                            const MessageRouter::WriteStats &writes,
+                                            const MessageRouter::PoolStats &pool) {
+    if (!isVisible()) {
+        return;
+    }
+    m_table->setRowCount(stats.size());
+    double totalIn = 0.0;
+    double totalOut = 0.0;
+    for (int row = 0; row < stats.size(); ++row) {
+        const MessageRouter::SessionStats &session = stats.at(row);
+        totalIn += session.inRate;
+        totalOut += session.outRate;
+        QString lane = session.bulk ? (session.stripe > 0 ? tr("批量 #%1").arg(session.stripe) : tr("批量"))
+                                    : tr("交互");
+        if (session.local) {
+            lane = tr("%1（本机）").arg(lane);
+        }
+        if (session.encrypted) {
+            lane = tr("%1（加密）").arg(lane);
+        }
+        const QString queued = session.congested ? tr("%1（拥塞）").arg(formatBytes(static_cast<quint64>(session.queuedBytes)))
+                                                 : formatBytes(static_cast<quint64>(session.queuedBytes));
+        const QStringList cells{peerName(session.peerId),
+                                lane,
+                                session.address,
+                                formatDuration(session.connectedMs),
+                                formatBytes(session.bytesIn),
+                                formatBytes(session.bytesOut),
+                                QStringLiteral("%1 / %2").arg(session.messagesIn).arg(session.messagesOut),
+                                QStringLiteral("%1 (%2)").arg(queued).arg(session.queuedMessages),
+                                formatRate(session.inRate),
+                                formatRate(session.outRate),
+                                QString::number(session.reconnects),
+                                QStringLiteral("%1 / %2")
+                                    .arg(latencyPercentile(session.ackLatency, 0.5),
+                                         latencyPercentile(session.ackLatency, 0.95)),
+                                session.rttMs < 0 ? QStringLiteral("-") : QStringLiteral("%1ms").arg(session.rttMs),
+                                session.rttMs < 0 ? QStringLiteral("-") : QStringLiteral("%1ms").arg(session.clockOffsetMs)};
+        for (int column = 0; column < cells.size(); ++column) {
+            auto *item = m_table->item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem;
+                m_table->setItem(row, column, item);
+            }
+            item->setText(cells.at(column));
+        }
+    }
+    QStringList summary{tr("共 %1 条连接，总接收 %2，总发送 %3")
+                            .arg(stats.size())
+                            .arg(formatRate(totalIn), formatRate(totalOut))};
+    summary.append(tr("发送 %1 条消息，写入调用 %2 次（合并省去 %3 次），内核写出 %4 次")
+                       .arg(writes.messages)
+                       .arg(writes.bufferWrites)
+                       .arg(writes.savedWrites())
+                       .arg(writes.flushes));
+    summary.append(tr("连接池 %1 / %2（建立中 %3），容量淘汰 %4 次，空闲关闭 %5 次")
+                       .arg(pool.openSessions)
+                       .arg(pool.capacity)
+                       .arg(pool.pendingSessions)
+                       .arg(pool.evictions)
+                       .arg(pool.idleClosures));
+    if (writes.compressedFrames > 0) {
+        summary.append(tr("压缩 %1 帧，节省 %2")
+                           .arg(writes.compressedFrames)
+                           .arg(formatBytes(writes.compressionSavedBytes)));
+    }
+    m_summary->setText(summary.join(QStringLiteral("\n")));
+}
+
+QString ConnectionInspectorDialog::peerName(const QString &peerId) const {
+    if (m_controller) {
+        if (auto *directory = m_controller->peerDirectory()) {
+            for (const PeerInfo &peer : directory->peers()) {
+                if (peer.id == peerId) {
+                    return peer.displayName.isEmpty() ? peerId : peer.displayName;
+                }
+            }
+        }
+    }
+    return peerId;
+}
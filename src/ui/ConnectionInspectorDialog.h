@@ -0,0 +1,35 @@
+#pragma once
+
+#include "core/ChatController.h"
+
+#include <QDialog>
+#include <QPointer>
+#include <QTimer>
+
+class QLabel;
+class QTableWidget;
+
+/*!
+ * \brief 连接诊断窗口，每秒刷新各会话的收发字节数、消息数、队列深度、吞吐、重连次数、确认延迟以及往返时延与时钟偏差，
+ *        并汇总发送路径的写入合并与压缩效果以及连接池的占用与回收情况。
+ */
+class ConnectionInspectorDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit ConnectionInspectorDialog(ChatController *controller, QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private:
+    void updateStats(const QVector<MessageRouter::SessionStats> &stats, const MessageRouter::WriteStats &writes,
+                     const MessageRouter::PoolStats &pool);
+    QString peerName(const QString &peerId) const;
+
+    QPointer<ChatController> m_controller;
+    QTableWidget *m_table = nullptr;
+    QLabel *m_summary = nullptr;
+    QTimer m_refreshTimer;
+};
@@ -16,6 +16,7 @@
 #include <QHBoxLayout>
 #include <QItemSelectionModel>
 #include <QListView>
+#include <QShortcut>
 #include <QStandardItemModel>
 #include <algorithm>
 
@@ -43,6 +44,9 @@ MainWindow::MainWindow(ChatController *controller, QWidget *parent)
     connect(m_chatPanel, &ChatPanel::sendRequested, this, &MainWindow::handleSend);
     connect(m_chatPanel, &ChatPanel::fileSendRequested, this, &MainWindow::handleSendFile);
     connect(m_chatPanel, &ChatPanel::shareCenterRequested, this, &MainWindow::openShareCenter);
+    // 连接诊断窗口面向排查问题，不占用界面入口，以快捷键打开。
+    auto *inspectorShortcut = new QShortcut(QKeySequence(QStringLiteral("Ctrl+Shift+D")), this);
+    connect(inspectorShortcut, &QShortcut::activated, this, &MainWindow::openConnectionInspector);
 
     connect(m_contactsSidebar, &ContactsSidebar::settingsRequested, this, &MainWindow::openSettingsDialog);
     connect(m_contactsSidebar, &ContactsSidebar::profileRequested, this, &MainWindow::openProfileDialog);
@@ -51,6 +55,8 @@ MainWindow::MainWindow(ChatController *controller, QWidget *parent)
     connect(m_controller, &ChatController::chatMessageReceived, this, &MainWindow::appendMessage);
     connect(m_controller, &ChatController::fileReceived, this, &MainWindow::handleFileReceived);
     connect(m_controller, &ChatController::shareCatalogReceived, this, &MainWindow::handleShareCatalog);
+    connect(m_controller, &ChatController::fileTransferStarted, this, &MainWindow::handleTransferProgress);
+    connect(m_controller, &ChatController::fileTransferProgress, this, &MainWindow::handleTransferProgress);
     connect(m_controller, &ChatController::statusInfo, this, &MainWindow::showStatus);
     connect(m_controller, &ChatController::controllerWarning, this, &MainWindow::showStatus);
     connect(m_controller, &ChatController::roleChanged, this, [this]() { refreshProfileCard(); });
@@ -306,6 +312,15 @@ void MainWindow::handleShareCatalog(const QString &peerId, const QList<SharedFil
     }
 }
 
+void MainWindow::handleTransferProgress(const FileTransferStatus &status) {
+    const int percent = status.totalBytes == 0
+                            ? 0
+                            : static_cast<int>(status.transferredBytes * 100 / status.totalBytes);
+    showStatus(LanguageManager::text(LangKey::MainWindow::TransferProgress, QStringLiteral("正在传输 %1：%2%"))
+                   .arg(status.fileName)
+                   .arg(percent));
+}
+
 void MainWindow::openShareCenter() {
     if (!m_controller) {
         return;
@@ -319,3 +334,15 @@ void MainWindow::openShareCenter() {
     m_shareDialog->raise();
     m_shareDialog->activateWindow();
 }
+
+void MainWindow::openConnectionInspector() {
+    if (!m_controller) {
+        return;
+    }
+    if (!m_inspectorDialog) {
+        m_inspectorDialog = new ConnectionInspectorDialog(m_controller, this);
+    }
+    m_inspectorDialog->show();
+    m_inspectorDialog->raise();
+    m_inspectorDialog->activateWindow();
+}
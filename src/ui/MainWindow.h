@@ -1,5 +1,6 @@
 #pragma once
 
+#include "ConnectionInspectorDialog.h"
 #include "ShareCenterDialog.h"
 #include "core/ChatController.h"
 
@@ -33,7 +34,9 @@ private slots:
     void handleFileReceived(const PeerInfo &peer, const QString &roleName, const QString &fileName,
                             const QString &path);
     void handleShareCatalog(const QString &peerId, const QList<SharedFileInfo> &files);
+    void handleTransferProgress(const FileTransferStatus &status);
     void openShareCenter();
+    void openConnectionInspector();
     void loadConversation(const QString &peerId, const QString &peerName);
     void handleSidebarTabChanged(int index);
 
@@ -54,5 +57,6 @@ private:
     QPointer<SettingsDialog> m_settingsDialog;
     QPointer<ShareCenterDialog> m_shareDialog;
     QPointer<ProfileDialog> m_profileDialog;
+    QPointer<ConnectionInspectorDialog> m_inspectorDialog;
     QHash<QString, QList<SharedFileInfo>> m_remoteShares;
 };
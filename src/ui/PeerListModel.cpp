@@ -1,11 +1,20 @@
 #include "PeerListModel.h"
 
+#include <QColor>
+
 PeerListModel::PeerListModel(PeerDirectory *directory, QObject *parent)
     : QAbstractListModel(parent), m_directory(directory) {
     if (m_directory) {
-        connect(m_directory, &PeerDirectory::peerListChanged, this, [this]() {
-            beginResetModel();
-            endResetModel();
+        // 按行增量通知视图，心跳合并不再触发整表重置。
+        connect(m_directory, &PeerDirectory::peerAboutToBeAdded, this,
+                [this](int row) { beginInsertRows(QModelIndex(), row, row); });
+        connect(m_directory, &PeerDirectory::peerAdded, this, [this]() { endInsertRows(); });
+        connect(m_directory, &PeerDirectory::peerAboutToBeRemoved, this,
+                [this](int row) { beginRemoveRows(QModelIndex(), row, row); });
+        connect(m_directory, &PeerDirectory::peerRemoved, this, [this]() { endRemoveRows(); });
+        connect(m_directory, &PeerDirectory::peerChanged, this, [this](int row) {
+            const QModelIndex changed = index(row);
+            emit dataChanged(changed, changed);
         });
     }
 }
@@ -31,7 +40,18 @@ QVariant PeerListModel::data(const QModelIndex &index, int role) const {
     case AddressRole:
         return QStringLiteral("%1:%2").arg(peer.address.toString()).arg(peer.listenPort);
     case StatusRole:
-        return peer.lastSeen.toString(Qt::ISODate);
+        return static_cast<int>(peer.presence);
+    case Qt::ToolTipRole: {
+        const QString presence = peer.presence == PeerPresence::Online ? tr("在线")
+                                 : peer.presence == PeerPresence::Away ? tr("离开")
+                                                                       : tr("离线");
+        return peer.lastSeen.isValid()
+                   ? tr("%1，最近出现于 %2").arg(presence, peer.lastSeen.toLocalTime().toString(Qt::ISODate))
+                   : presence;
+    }
+    case Qt::ForegroundRole:
+        // 离开与离线的联系人淡化显示，在线联系人使用默认前景色。
+        return peer.presence == PeerPresence::Online ? QVariant() : QVariant(QColor(Qt::gray));
     default:
         return {};
     }
@@ -311,6 +311,57 @@ QWidget *SettingsDialog::createNetworkPage() {
     interopLayout->addLayout(interopRow);
     layout->addWidget(interopSection);
 
+    auto *multicastSection = createSection(tr("组播发现"));
+    auto *multicastLayout = sectionLayout(multicastSection);
+    auto *multicastCheck = new QCheckBox(tr("使用组播发现联系人"), multicastSection);
+    multicastCheck->setObjectName(QStringLiteral("net_multicast"));
+    multicastLayout->addWidget(multicastCheck);
+    auto *multicastRow = new QHBoxLayout();
+    auto *groupLabel = new QLabel(tr("组播地址："), multicastSection);
+    auto *groupEdit = new QLineEdit(multicastSection);
+    groupEdit->setObjectName(QStringLiteral("net_multicastGroup"));
+    groupEdit->setPlaceholderText(QStringLiteral("239.255.77.77"));
+    auto *ttlLabel = new QLabel(tr("TTL："), multicastSection);
+    auto *ttlSpin = new QSpinBox(multicastSection);
+    ttlSpin->setRange(1, 255);
+    ttlSpin->setObjectName(QStringLiteral("net_multicastTtl"));
+    multicastRow->addWidget(groupLabel);
+    multicastRow->addWidget(groupEdit, 1);
+    multicastRow->addWidget(ttlLabel);
+    multicastRow->addWidget(ttlSpin, 0);
+    multicastLayout->addLayout(multicastRow);
+    auto *multicastHint = new QLabel(
+        tr("组播只唤醒运行本程序的主机，TTL 大于 1 时可经组播路由到达其他 VLAN；加入失败时自动改用广播。"
+           "网段内仍有使用广播发现的客户端时，心跳会同时广播给它们。"),
+        multicastSection);
+    multicastHint->setObjectName(QStringLiteral("hintLabel"));
+    multicastHint->setWordWrap(true);
+    multicastLayout->addWidget(multicastHint);
+    layout->addWidget(multicastSection);
+
+    auto *poolSection = createSection(tr("连接管理"));
+    auto *poolLayout = sectionLayout(poolSection);
+    auto *poolRow = new QHBoxLayout();
+    auto *maxSessionsLabel = new QLabel(tr("最大连接数："), poolSection);
+    auto *maxSessionsSpin = new QSpinBox(poolSection);
+    maxSessionsSpin->setRange(16, 4096);
+    maxSessionsSpin->setObjectName(QStringLiteral("net_maxSessions"));
+    auto *idleLabel = new QLabel(tr("空闲连接关闭（分钟）："), poolSection);
+    auto *idleSpin = new QSpinBox(poolSection);
+    idleSpin->setRange(1, 1440);
+    idleSpin->setObjectName(QStringLiteral("net_sessionIdle"));
+    poolRow->addWidget(maxSessionsLabel);
+    poolRow->addWidget(maxSessionsSpin, 0);
+    poolRow->addWidget(idleLabel);
+    poolRow->addWidget(idleSpin, 0);
+    poolRow->addStretch();
+    poolLayout->addLayout(poolRow);
+    auto *poolHint = new QLabel(tr("超出上限或空闲超时的连接会被关闭，再次发送时自动重新建立。"), poolSection);
+    poolHint->setObjectName(QStringLiteral("hintLabel"));
+    poolHint->setWordWrap(true);
+    poolLayout->addWidget(poolHint);
+    layout->addWidget(poolSection);
+
     auto *bindingSection = createSection(tr("网卡绑定"));
     auto *bindingLayout = sectionLayout(bindingSection);
     auto *bindCheck = new QCheckBox(tr("启用网卡绑定"), bindingSection);
@@ -842,6 +893,70 @@ void SettingsDialog::bindNetworkSettings(QWidget *section) {
             m_controller->updateNetworkSettings(prefs);
         });
     }
+    if (auto *multicastCheck = section->findChild<QCheckBox *>(QStringLiteral("net_multicast"))) {
+        multicastCheck->setChecked(settings.multicastDiscovery);
+        connect(multicastCheck, &QCheckBox::toggled, this, [this](bool state) {
+            if (!m_controller) {
+                return;
+            }
+            auto prefs = m_controller->settings().network;
+            prefs.multicastDiscovery = state;
+            m_controller->updateNetworkSettings(prefs);
+        });
+    }
+    if (auto *groupEdit = section->findChild<QLineEdit *>(QStringLiteral("net_multicastGroup"))) {
+        groupEdit->setText(settings.multicastGroup);
+        connect(groupEdit, &QLineEdit::editingFinished, this, [this, groupEdit]() {
+            if (!m_controller) {
+                return;
+            }
+            const QHostAddress group(groupEdit->text().trimmed());
+            auto prefs = m_controller->settings().network;
+            if (!group.isMulticast() || group.protocol() != QAbstractSocket::IPv4Protocol) {
+                groupEdit->setText(prefs.multicastGroup);
+                return;
+            }
+            prefs.multicastGroup = group.toString();
+            m_controller->updateNetworkSettings(prefs);
+        });
+    }
+    if (auto *ttlSpin = section->findChild<QSpinBox *>(QStringLiteral("net_multicastTtl"))) {
+        ttlSpin->setValue(settings.multicastTtl);
+        // 修改 TTL 会重新加入组播组，编辑完成后再生效，避免逐次调整时反复退出、加入。
+        connect(ttlSpin, &QSpinBox::editingFinished, this, [this, ttlSpin]() {
+            if (!m_controller) {
+                return;
+            }
+            auto prefs = m_controller->settings().network;
+            if (prefs.multicastTtl == ttlSpin->value()) {
+                return;
+            }
+            prefs.multicastTtl = ttlSpin->value();
+            m_controller->updateNetworkSettings(prefs);
+        });
+    }
+    if (auto *maxSessionsSpin = section->findChild<QSpinBox *>(QStringLiteral("net_maxSessions"))) {
+        maxSessionsSpin->setValue(settings.maxSessions);
+        connect(maxSessionsSpin, &QSpinBox::editingFinished, this, [this, maxSessionsSpin]() {
+            if (!m_controller) {
+                return;
+            }
+            auto prefs = m_controller->settings().network;
+            prefs.maxSessions = maxSessionsSpin->value();
+            m_controller->updateNetworkSettings(prefs);
+        });
+    }
+    if (auto *idleSpin = section->findChild<QSpinBox *>(QStringLiteral("net_sessionIdle"))) {
+        idleSpin->setValue(qMax(1, settings.sessionIdleTimeoutSeconds / 60));
+        connect(idleSpin, &QSpinBox::editingFinished, this, [this, idleSpin]() {
+            if (!m_controller) {
+                return;
+            }
+            auto prefs = m_controller->settings().network;
+            prefs.sessionIdleTimeoutSeconds = idleSpin->value() * 60;
+            m_controller->updateNetworkSettings(prefs);
+        });
+    }
     if (auto *bindCheck = section->findChild<QCheckBox *>(QStringLiteral("net_bindInterface"))) {
         auto *combo = section->findChild<QComboBox *>(QStringLiteral("net_interfaceCombo"));
         bindCheck->setChecked(settings.bindNetworkInterface);
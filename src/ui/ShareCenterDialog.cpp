@@ -57,6 +57,10 @@ ShareCenterDialog::ShareCenterDialog(ChatController *controller, QWidget *parent
 }
 
 void ShareCenterDialog::setPeerId(const QString &peerId) {
+    if (m_controller && !m_peerId.isEmpty() && m_peerId != peerId) {
+        // 切换联系人后前一位联系人的目录应答已无处展示，取消其在途请求。
+        m_controller->cancelPeerRequests(m_peerId);
+    }
     m_peerId = peerId;
 }
 
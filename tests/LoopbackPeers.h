@@ -0,0 +1,33 @@
+#pragma once
+
+#include "MessageRouter.h"
+
+#include <QTcpServer>
+
+/*!
+ * \brief 回环测试的公共辅助：在本机分配空闲端口，并构造指向回环地址的联系人。
+ */
+namespace LoopbackPeers {
+inline quint16 freePort() {
+    QTcpServer probe;
+    probe.listen(QHostAddress::LocalHost, 0);
+    return probe.serverPort();
+}
+
+/*!
+ * \brief peer 构造回环联系人，能力与本机相同；sealed 为 false 时去掉 seal/1，会话保持明文。
+ */
+inline PeerInfo peer(const QString &id, quint16 port, bool sealed = true) {
+    PeerInfo info;
+    info.id = id;
+    info.displayName = id;
+    info.address = QHostAddress::LocalHost;
+    info.listenPort = port;
+    QStringList capabilities = MessageRouter::localCapabilities().split(QLatin1Char(','));
+    if (!sealed) {
+        capabilities.removeAll(QString::fromLatin1(PeerCapability::SealedSession));
+    }
+    info.capabilities = capabilities.join(QLatin1Char(','));
+    return info;
+}
+} // namespace LoopbackPeers
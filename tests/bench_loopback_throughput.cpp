@@ -0,0 +1,141 @@
+#include "LoopbackPeers.h"
+
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QTimer>
+#include <QtTest>
+
+namespace {
+constexpr qint64 ChunkSize = 64 * 1024;
+constexpr qint64 StripeUnit = 1024 * 1024;
+constexpr qint64 TransferBytes = 256 * 1024 * 1024;
+constexpr int TransferTimeoutMs = 120 * 1000;
+} // namespace
+
+/*!
+ * \brief 回环吞吐基准：经批量通道按条带发送文件数据，统计接收端的吞吐；
+ *        随后收紧连接池，确认回收空闲条带不会被当作断线通知上层。
+ */
+class LoopbackThroughputBench : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void stripedThroughput_data();
+    void stripedThroughput();
+    void poolReleaseIsSilent();
+
+private:
+    void pump();
+
+    MessageRouter *m_sender = nullptr;
+    MessageRouter *m_receiver = nullptr;
+    PeerInfo m_toReceiver;
+    int m_stripes = 1;
+    qint64 m_sent = 0;
+    qint64 m_received = 0;
+};
+
+void LoopbackThroughputBench::init() {
+    m_sender = new MessageRouter(this);
+    m_receiver = new MessageRouter(this);
+    m_sender->setLocalPeerId(QStringLiteral("sender"));
+    m_receiver->setLocalPeerId(QStringLiteral("receiver"));
+    m_sender->setWriteBatching(true);
+    const quint16 senderPort = LoopbackPeers::freePort();
+    const quint16 receiverPort = LoopbackPeers::freePort();
+    QVERIFY(m_sender->startListening(senderPort));
+    QVERIFY(m_receiver->startListening(receiverPort));
+    m_toReceiver = LoopbackPeers::peer(QStringLiteral("receiver"), receiverPort);
+    m_sender->rememberPeer(m_toReceiver);
+    m_receiver->rememberPeer(LoopbackPeers::peer(QStringLiteral("sender"), senderPort));
+    m_sent = 0;
+    m_received = 0;
+    connect(m_receiver, &MessageRouter::fileChunkReceived, this,
+            [this](const QString &, const QString &, quint64, const QByteArray &data) { m_received += data.size(); });
+    connect(m_sender, &MessageRouter::peerBackpressure, this, [this](const QString &, bool congested) {
+        if (!congested) {
+            pump();
+        }
+    });
+}
+
+void LoopbackThroughputBench::cleanup() {
+    m_sender->stop();
+    m_receiver->stop();
+    delete m_sender;
+    delete m_receiver;
+    m_sender = nullptr;
+    m_receiver = nullptr;
+}
+
+void LoopbackThroughputBench::pump() {
+    // 与文件传输模块相同：每个条带单元连续写在同一条连接上，连接拥塞时停下，等背压解除再继续。
+    static const QByteArray chunk(ChunkSize, 'x');
+    while (m_sent < TransferBytes) {
+        const int stripe = static_cast<int>(m_sent / StripeUnit) % m_stripes;
+        if (!m_sender->canSendBulk(m_toReceiver, stripe) ||
+            !m_sender->sendFileChunk(m_toReceiver, QStringLiteral("bench"), static_cast<quint64>(m_sent), chunk,
+                                     stripe)) {
+            return;
+        }
+        m_sent += ChunkSize;
+    }
+}
+
+void LoopbackThroughputBench::stripedThroughput_data() {
+    QTest::addColumn<int>("stripes");
+    QTest::newRow("1 stripe") << 1;
+    QTest::newRow("4 stripes") << 4;
+}
+
+void LoopbackThroughputBench::stripedThroughput() {
+    QFETCH(int, stripes);
+    m_stripes = stripes;
+    // 背压解除信号只在越过高水位之后才会出现，定时补发一次，避免连接建立前入队受阻后停住。
+    QTimer kick;
+    kick.setInterval(10);
+    connect(&kick, &QTimer::timeout, this, [this]() { pump(); });
+    kick.start();
+
+    QElapsedTimer clock;
+    clock.start();
+    QBENCHMARK_ONCE {
+        pump();
+        QTRY_COMPARE_WITH_TIMEOUT(m_received, TransferBytes, TransferTimeoutMs);
+    }
+    const double seconds = qMax<qint64>(1, clock.elapsed()) / 1000.0;
+    qInfo("%d stripe(s): %.1f MB/s", stripes, static_cast<double>(TransferBytes) / (1024.0 * 1024.0) / seconds);
+}
+
+void LoopbackThroughputBench::poolReleaseIsSilent() {
+    m_stripes = 4;
+    QTimer kick;
+    kick.setInterval(10);
+    connect(&kick, &QTimer::timeout, this, [this]() { pump(); });
+    kick.start();
+    pump();
+    QTRY_COMPARE_WITH_TIMEOUT(m_received, TransferBytes, TransferTimeoutMs);
+    kick.stop();
+    QVERIFY(m_sender->poolStats().openSessions > 1);
+
+    // 收紧连接池回收空闲条带：两端都不应把主动回收当作断线。
+    QSignalSpy senderClosed(m_sender, &MessageRouter::sessionClosed);
+    QSignalSpy senderStripes(m_sender, &MessageRouter::stripeClosed);
+    QSignalSpy receiverClosed(m_receiver, &MessageRouter::sessionClosed);
+    QSignalSpy receiverStripes(m_receiver, &MessageRouter::stripeClosed);
+    m_sender->setSessionLimits(1, 600);
+    QCOMPARE(m_sender->poolStats().openSessions, 1);
+    QTRY_COMPARE_WITH_TIMEOUT(m_receiver->poolStats().openSessions, 1, TransferTimeoutMs);
+    // 等退役握手完成、连接真正关闭后再检查。
+    QTest::qWait(3000);
+    QCOMPARE(senderClosed.count(), 0);
+    QCOMPARE(senderStripes.count(), 0);
+    QCOMPARE(receiverClosed.count(), 0);
+    QCOMPARE(receiverStripes.count(), 0);
+}
+
+QTEST_GUILESS_MAIN(LoopbackThroughputBench)
+
+#include "bench_loopback_throughput.moc"
@@ -0,0 +1,87 @@
+#include "LoopbackPeers.h"
+
+#include <QStringList>
+#include <QTimer>
+#include <QtTest>
+
+namespace {
+constexpr int MessagesPerSide = 400;
+constexpr int MergeTimeoutMs = 15000;
+} // namespace
+
+/*!
+ * \brief 重复连接合并：双方同时发起连接并在合并期间持续发消息，任何一条都不能丢失，且按发送顺序到达。
+ */
+class RouterMergeTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void simultaneousOpenKeepsAllMessages();
+};
+
+void RouterMergeTest::simultaneousOpenKeepsAllMessages() {
+    MessageRouter alice;
+    MessageRouter bob;
+    alice.setLocalPeerId(QStringLiteral("a"));
+    bob.setLocalPeerId(QStringLiteral("b"));
+    const quint16 alicePort = LoopbackPeers::freePort();
+    const quint16 bobPort = LoopbackPeers::freePort();
+    QVERIFY(alice.startListening(alicePort));
+    QVERIFY(bob.startListening(bobPort));
+    const PeerInfo toBob = LoopbackPeers::peer(QStringLiteral("b"), bobPort);
+    const PeerInfo toAlice = LoopbackPeers::peer(QStringLiteral("a"), alicePort);
+    alice.rememberPeer(toBob);
+    bob.rememberPeer(toAlice);
+
+    QStringList aliceReceived;
+    QStringList bobReceived;
+    connect(&alice, &MessageRouter::messageReceived, this, [&aliceReceived](const PeerInfo &, const QJsonObject &payload) {
+        if (payload.value(QStringLiteral("type")).toString() == QStringLiteral("chat")) {
+            aliceReceived.append(payload.value(QStringLiteral("text")).toString());
+        }
+    });
+    connect(&bob, &MessageRouter::messageReceived, this, [&bobReceived](const PeerInfo &, const QJsonObject &payload) {
+        if (payload.value(QStringLiteral("type")).toString() == QStringLiteral("chat")) {
+            bobReceived.append(payload.value(QStringLiteral("text")).toString());
+        }
+    });
+
+    // 两端在同一轮事件循环里互发首条消息，各自发起连接，形成两条重复会话；
+    // 之后每个事件循环周期两端各发一条，合并、移交队列与退役握手都发生在持续收发期间。
+    int sent = 0;
+    QTimer pump;
+    pump.setInterval(0);
+    connect(&pump, &QTimer::timeout, this, [&]() {
+        const QString index = QString::number(sent);
+        alice.sendChatMessage(toBob, QStringLiteral("a-") + index, QString(), QString());
+        bob.sendChatMessage(toAlice, QStringLiteral("b-") + index, QString(), QString());
+        if (++sent == MessagesPerSide) {
+            pump.stop();
+        }
+    });
+    pump.start();
+
+    QTRY_COMPARE_WITH_TIMEOUT(bobReceived.size(), MessagesPerSide, MergeTimeoutMs);
+    QTRY_COMPARE_WITH_TIMEOUT(aliceReceived.size(), MessagesPerSide, MergeTimeoutMs);
+    // 旧连接上已写出的消息与移交到新连接的后续消息不能交错：每个发送方的消息按发送顺序到达，也没有重复。
+    for (int i = 0; i < MessagesPerSide; ++i) {
+        QCOMPARE(bobReceived.at(i), QStringLiteral("a-%1").arg(i));
+        QCOMPARE(aliceReceived.at(i), QStringLiteral("b-%1").arg(i));
+    }
+
+    // 合并完成后每端只登记一条交互会话，退役的连接不再参与发送。
+    QTRY_COMPARE_WITH_TIMEOUT(alice.sessionStats().size(), 1, MergeTimeoutMs);
+    QTRY_COMPARE_WITH_TIMEOUT(bob.sessionStats().size(), 1, MergeTimeoutMs);
+    QCOMPARE(alice.poolStats().openSessions, 1);
+
+    // 合并后的会话继续可用。
+    alice.sendChatMessage(toBob, QStringLiteral("after-merge"), QString(), QString());
+    QTRY_VERIFY_WITH_TIMEOUT(bobReceived.contains(QStringLiteral("after-merge")), MergeTimeoutMs);
+
+    alice.stop();
+    bob.stop();
+}
+
+QTEST_GUILESS_MAIN(RouterMergeTest)
+
+#include "tst_router_merge.moc"